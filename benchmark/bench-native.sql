@@ -16,6 +16,17 @@ EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT
 EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM small_random GROUP BY col_b) AS foo;
 EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM small_correlated GROUP BY col_b) AS foo;
 EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_correlated GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM small_zipf) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM small_zipf GROUP BY col_b) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM small_zipf GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM small_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM small_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM small_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM small_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_groups GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_giant GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
 
 EXPLAIN SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM medium_1) AS foo;
 EXPLAIN SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_b) AS b FROM medium_1) AS foo;
@@ -33,6 +44,17 @@ EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT
 EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM medium_random GROUP BY col_b) AS foo;
 EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM medium_correlated GROUP BY col_b) AS foo;
 EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_correlated GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM medium_zipf) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM medium_zipf GROUP BY col_b) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM medium_zipf GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM medium_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM medium_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_groups GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_giant GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
 
 EXPLAIN SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM large_1) AS foo;
 EXPLAIN SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_b) AS b FROM large_1) AS foo;
@@ -50,6 +72,17 @@ EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT
 EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM large_correlated GROUP BY col_b) AS foo;
 EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_correlated GROUP BY col_a) AS foo;
 
+EXPLAIN SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM large_zipf) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM large_zipf GROUP BY col_b) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM large_zipf GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM large_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM large_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM large_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM large_types GROUP BY col_grp) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_groups GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_giant GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+EXPLAIN SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
 \timing on
 
 \echo SMALL QUERY 1
@@ -180,6 +213,94 @@ SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINC
 SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_correlated GROUP BY col_a) AS foo;
 SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_correlated GROUP BY col_a) AS foo;
 
+\echo SMALL QUERY 17
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM small_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM small_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM small_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM small_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM small_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM small_zipf) AS foo;
+
+\echo SMALL QUERY 18
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM small_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM small_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM small_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM small_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM small_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM small_zipf GROUP BY col_b) AS foo;
+
+\echo SMALL QUERY 19
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM small_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM small_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM small_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM small_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM small_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM small_zipf GROUP BY col_a) AS foo;
+
+\echo SMALL QUERY 20
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM small_types GROUP BY col_grp) AS foo;
+
+\echo SMALL QUERY 21
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM small_types GROUP BY col_grp) AS foo;
+
+\echo SMALL QUERY 22
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM small_types GROUP BY col_grp) AS foo;
+
+\echo SMALL QUERY 23
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM small_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM small_types GROUP BY col_grp) AS foo;
+
+\echo SMALL QUERY 24
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_groups GROUP BY col_a) AS foo;
+
+\echo SMALL QUERY 25
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM small_giant GROUP BY col_a) AS foo;
+
+\echo SMALL QUERY 26
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+
+\echo SMALL QUERY 27
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM small_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+
 
 \echo MEDIUM QUERY 1
 SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM medium_1) AS foo;
@@ -309,6 +430,94 @@ SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINC
 SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_correlated GROUP BY col_a) AS foo;
 SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_correlated GROUP BY col_a) AS foo;
 
+\echo MEDIUM QUERY 17
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM medium_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM medium_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM medium_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM medium_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM medium_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM medium_zipf) AS foo;
+
+\echo MEDIUM QUERY 18
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM medium_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM medium_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM medium_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM medium_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM medium_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM medium_zipf GROUP BY col_b) AS foo;
+
+\echo MEDIUM QUERY 19
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM medium_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM medium_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM medium_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM medium_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM medium_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM medium_zipf GROUP BY col_a) AS foo;
+
+\echo MEDIUM QUERY 20
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM medium_types GROUP BY col_grp) AS foo;
+
+\echo MEDIUM QUERY 21
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+
+\echo MEDIUM QUERY 22
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM medium_types GROUP BY col_grp) AS foo;
+
+\echo MEDIUM QUERY 23
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM medium_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM medium_types GROUP BY col_grp) AS foo;
+
+\echo MEDIUM QUERY 24
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_groups GROUP BY col_a) AS foo;
+
+\echo MEDIUM QUERY 25
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM medium_giant GROUP BY col_a) AS foo;
+
+\echo MEDIUM QUERY 26
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+
+\echo MEDIUM QUERY 27
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM medium_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+
 
 
 \echo LARGE QUERY 1
@@ -438,3 +647,91 @@ SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINC
 SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_correlated GROUP BY col_a) AS foo;
 SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_correlated GROUP BY col_a) AS foo;
 SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_correlated GROUP BY col_a) AS foo;
+
+\echo LARGE QUERY 17
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM large_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM large_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM large_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM large_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM large_zipf) AS foo;
+SELECT COUNT(*), AVG(b), SUM(b) FROM (SELECT COUNT(DISTINCT col_a) AS b FROM large_zipf) AS foo;
+
+\echo LARGE QUERY 18
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM large_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM large_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM large_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM large_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM large_zipf GROUP BY col_b) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_b AS a, COUNT(DISTINCT col_a) AS b FROM large_zipf GROUP BY col_b) AS foo;
+
+\echo LARGE QUERY 19
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM large_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM large_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM large_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM large_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM large_zipf GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_c) AS b FROM large_zipf GROUP BY col_a) AS foo;
+
+\echo LARGE QUERY 20
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int2) AS b FROM large_types GROUP BY col_grp) AS foo;
+
+\echo LARGE QUERY 21
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_int8) AS b FROM large_types GROUP BY col_grp) AS foo;
+
+\echo LARGE QUERY 22
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_float8) AS b FROM large_types GROUP BY col_grp) AS foo;
+
+\echo LARGE QUERY 23
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM large_types GROUP BY col_grp) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_grp AS a, COUNT(DISTINCT col_ts) AS b FROM large_types GROUP BY col_grp) AS foo;
+
+\echo LARGE QUERY 24
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_groups GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_groups GROUP BY col_a) AS foo;
+
+\echo LARGE QUERY 25
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_giant GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT col_b) AS b FROM large_giant GROUP BY col_a) AS foo;
+
+\echo LARGE QUERY 26
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, COUNT(DISTINCT e) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+
+\echo LARGE QUERY 27
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
+SELECT COUNT(*), COUNT(a), AVG(b), SUM(b) FROM (SELECT col_a AS a, CARDINALITY(ARRAY_AGG(DISTINCT e)) AS b FROM large_arrays, unnest(col_arr) e GROUP BY col_a) AS foo;
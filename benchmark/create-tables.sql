@@ -49,6 +49,50 @@ CREATE TABLE small_correlated (
 
 INSERT INTO small_correlated SELECT (i + 100*random())::int, i/1000 FROM generate_series(1,100000) s(i);
 
+-- skewed (zipf-like) values, P(k) ~ 1/k, i.e. a few very frequent values and a long tail
+CREATE TABLE small_zipf (
+    col_a   INT,
+    col_b   INT,
+    col_c   INT
+);
+
+INSERT INTO small_zipf SELECT floor(power(100000, random()))::int, mod(i,100), (100000*random())::int FROM generate_series(1,100000) s(i);
+
+-- wider and narrower types (100 groups)
+CREATE TABLE small_types (
+    col_grp     INT,
+    col_int2    SMALLINT,
+    col_int8    BIGINT,
+    col_float8  FLOAT8,
+    col_ts      TIMESTAMP
+);
+
+INSERT INTO small_types SELECT mod(i,100), (30000*random())::smallint, (1000000000000*random())::bigint, (100000*random())::int / 10.0, '2020-01-01'::timestamp + (100000*random())::int * interval '1 second' FROM generate_series(1,100000) s(i);
+
+-- many groups with tiny sets (4 rows per group)
+CREATE TABLE small_groups (
+    col_a   INT,
+    col_b   INT
+);
+
+INSERT INTO small_groups SELECT i/4, (1000*random())::int FROM generate_series(1,100000) s(i);
+
+-- a few giant groups (4 groups)
+CREATE TABLE small_giant (
+    col_a   INT,
+    col_b   INT
+);
+
+INSERT INTO small_giant SELECT mod(i,4), (100000*random())::int FROM generate_series(1,100000) s(i);
+
+-- arrays with 1-20 random elements (1/10 of the rows, about the same number of elements), 1000 groups
+CREATE TABLE small_arrays (
+    col_a   INT,
+    col_arr INT[]
+);
+
+INSERT INTO small_arrays SELECT mod(i,1000), ARRAY(SELECT (10000*random())::int FROM generate_series(1, 1 + mod(i,20))) FROM generate_series(1,10000) s(i);
+
 
 ANALYZE small_1;
 ANALYZE small_10;
@@ -56,6 +100,11 @@ ANALYZE small_100;
 ANALYZE small_10000;
 ANALYZE small_random;
 ANALYZE small_correlated;
+ANALYZE small_zipf;
+ANALYZE small_types;
+ANALYZE small_groups;
+ANALYZE small_giant;
+ANALYZE small_arrays;
 
 
 
@@ -110,6 +159,50 @@ CREATE TABLE medium_correlated (
 
 INSERT INTO medium_correlated SELECT (i + 100*random())::int, i/1000 FROM generate_series(1,10000000) s(i);
 
+-- skewed (zipf-like) values, P(k) ~ 1/k, i.e. a few very frequent values and a long tail
+CREATE TABLE medium_zipf (
+    col_a   INT,
+    col_b   INT,
+    col_c   INT
+);
+
+INSERT INTO medium_zipf SELECT floor(power(10000000, random()))::int, mod(i,100), (10000000*random())::int FROM generate_series(1,10000000) s(i);
+
+-- wider and narrower types (100 groups)
+CREATE TABLE medium_types (
+    col_grp     INT,
+    col_int2    SMALLINT,
+    col_int8    BIGINT,
+    col_float8  FLOAT8,
+    col_ts      TIMESTAMP
+);
+
+INSERT INTO medium_types SELECT mod(i,100), (30000*random())::smallint, (1000000000000*random())::bigint, (10000000*random())::int / 10.0, '2020-01-01'::timestamp + (10000000*random())::int * interval '1 second' FROM generate_series(1,10000000) s(i);
+
+-- many groups with tiny sets (4 rows per group)
+CREATE TABLE medium_groups (
+    col_a   INT,
+    col_b   INT
+);
+
+INSERT INTO medium_groups SELECT i/4, (1000*random())::int FROM generate_series(1,10000000) s(i);
+
+-- a few giant groups (4 groups)
+CREATE TABLE medium_giant (
+    col_a   INT,
+    col_b   INT
+);
+
+INSERT INTO medium_giant SELECT mod(i,4), (10000000*random())::int FROM generate_series(1,10000000) s(i);
+
+-- arrays with 1-20 random elements (1/10 of the rows, about the same number of elements), 1000 groups
+CREATE TABLE medium_arrays (
+    col_a   INT,
+    col_arr INT[]
+);
+
+INSERT INTO medium_arrays SELECT mod(i,1000), ARRAY(SELECT (1000000*random())::int FROM generate_series(1, 1 + mod(i,20))) FROM generate_series(1,1000000) s(i);
+
 
 ANALYZE medium_1;
 ANALYZE medium_10;
@@ -117,6 +210,11 @@ ANALYZE medium_100;
 ANALYZE medium_10000;
 ANALYZE medium_random;
 ANALYZE medium_correlated;
+ANALYZE medium_zipf;
+ANALYZE medium_types;
+ANALYZE medium_groups;
+ANALYZE medium_giant;
+ANALYZE medium_arrays;
 
 
 
@@ -171,10 +269,59 @@ CREATE TABLE large_correlated (
 
 INSERT INTO large_correlated SELECT (i + 100*random())::int, i/1000 FROM generate_series(1,100000000) s(i);
 
+-- skewed (zipf-like) values, P(k) ~ 1/k, i.e. a few very frequent values and a long tail
+CREATE TABLE large_zipf (
+    col_a   INT,
+    col_b   INT,
+    col_c   INT
+);
+
+INSERT INTO large_zipf SELECT floor(power(100000000, random()))::int, mod(i,100), (100000000*random())::int FROM generate_series(1,100000000) s(i);
+
+-- wider and narrower types (100 groups)
+CREATE TABLE large_types (
+    col_grp     INT,
+    col_int2    SMALLINT,
+    col_int8    BIGINT,
+    col_float8  FLOAT8,
+    col_ts      TIMESTAMP
+);
+
+INSERT INTO large_types SELECT mod(i,100), (30000*random())::smallint, (1000000000000*random())::bigint, (100000000*random())::int / 10.0, '2020-01-01'::timestamp + (100000000*random())::int * interval '1 second' FROM generate_series(1,100000000) s(i);
+
+-- many groups with tiny sets (4 rows per group)
+CREATE TABLE large_groups (
+    col_a   INT,
+    col_b   INT
+);
+
+INSERT INTO large_groups SELECT i/4, (1000*random())::int FROM generate_series(1,100000000) s(i);
+
+-- a few giant groups (4 groups)
+CREATE TABLE large_giant (
+    col_a   INT,
+    col_b   INT
+);
+
+INSERT INTO large_giant SELECT mod(i,4), (100000000*random())::int FROM generate_series(1,100000000) s(i);
+
+-- arrays with 1-20 random elements (1/10 of the rows, about the same number of elements), 1000 groups
+CREATE TABLE large_arrays (
+    col_a   INT,
+    col_arr INT[]
+);
+
+INSERT INTO large_arrays SELECT mod(i,1000), ARRAY(SELECT (10000000*random())::int FROM generate_series(1, 1 + mod(i,20))) FROM generate_series(1,10000000) s(i);
+
 
 ANALYZE large_1;
 ANALYZE large_10;
 ANALYZE large_100;
 ANALYZE large_10000;
 ANALYZE large_random;
-ANALYZE large_correlated;
\ No newline at end of file
+ANALYZE large_correlated;
+ANALYZE large_zipf;
+ANALYZE large_types;
+ANALYZE large_groups;
+ANALYZE large_giant;
+ANALYZE large_arrays;
\ No newline at end of file
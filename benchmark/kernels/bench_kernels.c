@@ -0,0 +1,686 @@
+/*
+ * bench_kernels.c - microbenchmarks of the element_set kernels
+ *
+ * Runs the kernels from element_set.h on arrays of items built directly in
+ * malloc'ed memory (without the server), for synthetic distributions of the
+ * values and the supported kinds of items, and reports the time per input
+ * value (and hardware counters, when perf_event_open is available).
+ *
+ * Only the kernels themselves are measured, not the policy deciding when
+ * count_distinct.c calls them (compaction trigger, growth of the data array,
+ * arena management), which lives in count_distinct.c and is measured by the
+ * SQL benchmarks. The phases are:
+ *
+ * - sort         sorting all the items (qsort_arg, the way compact_set sorts
+ *                a batch of new items), or with -j partition_items followed
+ *                by sort_partitions in that many threads
+ * - dedup        dedup_sorted on the sorted items
+ * - merge        merge_items of two sorted halves into a new array (the merge
+ *                done by compact_set), or merge_items_parallel with -j
+ * - merge_back   merge_items_backward of two sorted halves in place (the
+ *                merge done by the combine function)
+ * - pack_items   pack_items on the deduplicated items (the copy of the items
+ *                and values done by serialize_set, without the header)
+ *
+ * Usage: bench_kernels [-n values] [-r repeats] [-t typlen] [-d dist] [-j threads] [-P]
+ */
+#include "pg_shim.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#define HAVE_PERF_EVENTS
+#endif
+
+#include "../../element_set.h"
+
+/* partitions (or merged chunks) per thread with -j, see sort_items */
+#define TASKS_PER_THREAD	8
+
+#define NPHASES		5
+
+static const char *phase_names[NPHASES] = {"sort", "dedup", "merge", "merge_back",
+											"pack_items"};
+
+typedef enum dist_t
+{
+	DIST_UNIFORM,
+	DIST_ZIPF,
+	DIST_SORTED,
+	DIST_DUPLICATE
+} dist_t;
+
+static const char *dist_names[] = {"uniform", "zipf", "sorted", "duplicate"};
+
+/* item kinds - typlen and key kind */
+typedef struct kind_t
+{
+	int16	typlen;
+	char	keykind;
+	char	typalign;
+} kind_t;
+
+static const kind_t kinds[] = {
+	{1, KEY_UNSIGNED, 'c'},
+	{2, KEY_SIGNED, 's'},
+	{4, KEY_SIGNED, 'i'},
+	{8, KEY_SIGNED, 'd'},
+	{16, KEY_BINARY, 'c'},
+	{-1, KEY_VARLENA, 'i'}
+};
+
+/* hardware counters (per phase) */
+#define NCOUNTERS	4
+
+static const char *counter_names[NCOUNTERS] = {"cycles", "instructions",
+											   "cache-misses", "branch-misses"};
+
+typedef struct result_t
+{
+	double	ns;
+	uint64	counters[NCOUNTERS];
+	bool	have_counters;
+} result_t;
+
+static int	counter_fds[NCOUNTERS] = {-1, -1, -1, -1};
+
+/* threads used to sort and merge (-j) */
+static int	nthreads = 1;
+
+/* the results are read into this, so that the kernels are not optimized out */
+static volatile char sink;
+
+static void *
+xmalloc(Size size)
+{
+	void   *ptr = malloc(size);
+
+	if (ptr == NULL)
+	{
+		fprintf(stderr, "out of memory (%zu bytes)\n", size);
+		exit(1);
+	}
+
+	return ptr;
+}
+
+/* xorshift64*, fixed seed so that the runs are repeatable */
+static uint64 rng_state = UINT64CONST(0x2545F4914F6CDD1D);
+
+static uint64
+rng_next(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+
+	return rng_state * UINT64CONST(0x2545F4914F6CDD1D);
+}
+
+static double
+rng_double(void)
+{
+	return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * generate the values (as integers, turned into items of the right kind by
+ * build_items) - uniform and zipf (s = 1.1) values are from [0, n), so that
+ * the uniform ones are ~63% distinct
+ */
+static uint64 *
+generate_values(dist_t dist, uint32 n)
+{
+	uint64 *values = xmalloc(sizeof(uint64) * n);
+	uint32	i;
+
+	switch (dist)
+	{
+		case DIST_UNIFORM:
+			for (i = 0; i < n; i++)
+				values[i] = rng_next() % n;
+			break;
+
+		case DIST_ZIPF:
+		{
+			/* inverse of the CDF, using a binary search */
+			double *cdf = xmalloc(sizeof(double) * n);
+			double	sum = 0;
+
+			for (i = 0; i < n; i++)
+			{
+				sum += 1.0 / pow(i + 1, 1.1);
+				cdf[i] = sum;
+			}
+
+			for (i = 0; i < n; i++)
+			{
+				double	u = rng_double() * sum;
+				uint32	lo = 0,
+						hi = n - 1;
+
+				while (lo < hi)
+				{
+					uint32	mid = lo + (hi - lo) / 2;
+
+					if (cdf[mid] < u)
+						lo = mid + 1;
+					else
+						hi = mid;
+				}
+
+				/* spread the frequent values over the domain */
+				values[i] = (lo * UINT64CONST(0x9E3779B97F4A7C15)) % n;
+			}
+
+			free(cdf);
+			break;
+		}
+
+		case DIST_SORTED:
+			for (i = 0; i < n; i++)
+				values[i] = i;
+			break;
+
+		case DIST_DUPLICATE:
+			for (i = 0; i < n; i++)
+				values[i] = 42;
+			break;
+	}
+
+	return values;
+}
+
+/*
+ * Build an array of items of the kind from the values (and for varlena
+ * items also the arena with the values, formatted as short strings). The
+ * set only describes the items, nothing is ever added to it.
+ */
+static element_set_t *
+build_items(const kind_t *kind, uint64 *values, uint32 n)
+{
+	element_set_t  *eset = xmalloc(sizeof(element_set_t));
+	uint32			i;
+
+	memset(eset, 0, sizeof(element_set_t));
+
+	eset->typlen = kind->typlen;
+	eset->typalign = kind->typalign;
+	eset->keykind = kind->keykind;
+	eset->itemlen = (kind->typlen == -1) ? sizeof(varlena_item_t) : kind->typlen;
+	eset->nbytes = (Size) n * eset->itemlen;
+	eset->data = xmalloc(eset->nbytes);
+
+	if (kind->typlen == -1)
+	{
+		/* "value-" and up to 20 digits, with the header and alignment */
+		eset->arena_size = (Size) n * (VARHDRSZ + 32);
+		eset->arena = xmalloc(eset->arena_size);
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		char   *item = eset->data + (Size) i * eset->itemlen;
+		uint64	value = values[i];
+
+		switch (kind->typlen)
+		{
+			case 1:
+			{
+				uint8	v = (uint8) value;
+
+				memcpy(item, &v, 1);
+				break;
+			}
+			case 2:
+			{
+				int16	v = (int16) value;
+
+				encode_key(eset->keykind, (char *) &v, 2);
+				memcpy(item, &v, 2);
+				break;
+			}
+			case 4:
+			{
+				int32	v = (int32) value;
+
+				encode_key(eset->keykind, (char *) &v, 4);
+				memcpy(item, &v, 4);
+				break;
+			}
+			case 8:
+			{
+				int64	v = (int64) value;
+
+				encode_key(eset->keykind, (char *) &v, 8);
+				memcpy(item, &v, 8);
+				break;
+			}
+			case 16:
+			{
+				/* uuid-like, the value mixed into both halves */
+				uint64	v[2];
+
+				v[0] = value * UINT64CONST(0x9E3779B97F4A7C15);
+				v[1] = value;
+				memcpy(item, v, 16);
+				break;
+			}
+			default:
+			{
+				/* text-like, the value formatted as a short string */
+				varlena_item_t	vitem;
+				char	buf[32];
+				int		len = snprintf(buf, sizeof(buf), "value-%llu",
+									   (unsigned long long) value);
+				Size	offset = att_align_nominal(eset->arena_used, eset->typalign);
+
+				/* the kernels only use the item length, not the varlena header */
+				*(int32 *) (eset->arena + offset) = VARHDRSZ + len;
+				memcpy(VARDATA(eset->arena + offset), buf, len);
+				eset->arena_used = offset + VARHDRSZ + len;
+
+				vitem.hash = hash_bytes_64((const unsigned char *) buf, len);
+				vitem.offset = offset;
+				vitem.length = len;
+
+				memcpy(item, &vitem, sizeof(varlena_item_t));
+				break;
+			}
+		}
+	}
+
+	eset->nall = n;
+
+	return eset;
+}
+
+static void
+free_items(element_set_t *eset)
+{
+	free(eset->data);
+	free(eset->arena);
+	free(eset);
+}
+
+/* sort the items, either at once or in partitions (by multiple threads) */
+static void
+sort_all(element_set_t *eset, char *base, uint32 nitems)
+{
+	int		nbits = 0;
+	uint32 *bounds;
+	char	tmp[sizeof(varlena_item_t) + sizeof(uint64)];
+
+	if (nthreads == 1)
+	{
+		qsort_arg(base, nitems, eset->itemlen, get_compare_func(eset), eset);
+		return;
+	}
+
+	while ((1 << nbits) < nthreads * TASKS_PER_THREAD)
+		nbits++;
+
+	bounds = xmalloc((2 * (1 << nbits) + 1) * sizeof(uint32));
+
+	partition_items(eset, base, nitems, nbits, bounds, bounds + (1 << nbits) + 1, tmp);
+	sort_partitions(eset, base, bounds, 1 << nbits, nthreads);
+
+	free(bounds);
+}
+
+/* merge two sorted arrays into a new one (by multiple threads) */
+static char *
+merge_all(element_set_t *eset, char *a, uint32 na, char *b, uint32 nb, char *out)
+{
+	uint32	nchunks = nthreads * TASKS_PER_THREAD;
+	uint32 *bounds;
+	char   *end;
+
+	if (nthreads == 1)
+		return merge_items(eset, a, a + (Size) na * eset->itemlen,
+						   b, b + (Size) nb * eset->itemlen, out, 0);
+
+	bounds = xmalloc(3 * (nchunks + 1) * sizeof(uint32));
+	end = merge_items_parallel(eset, a, na, b, nb, out, nchunks, nthreads, bounds);
+	free(bounds);
+
+	return end;
+}
+
+static double
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#ifdef HAVE_PERF_EVENTS
+static int
+open_counter(uint64 config, int group)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = config;
+	attr.disabled = (group == -1);
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+/*
+ * open the hardware counters as a group (so that they're measured at the
+ * same time), returns false when not available (e.g. in a container, or with
+ * kernel.perf_event_paranoid too high)
+ */
+static bool
+counters_open(void)
+{
+#ifdef HAVE_PERF_EVENTS
+	static const uint64 configs[NCOUNTERS] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+	int		i;
+
+	for (i = 0; i < NCOUNTERS; i++)
+	{
+		counter_fds[i] = open_counter(configs[i], (i == 0) ? -1 : counter_fds[0]);
+
+		if (counter_fds[i] < 0)
+		{
+			fprintf(stderr, "perf_event_open failed (%s), hardware counters disabled\n",
+					strerror(errno));
+
+			while (i-- > 0)
+			{
+				close(counter_fds[i]);
+				counter_fds[i] = -1;
+			}
+
+			return false;
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+static void
+counters_start(void)
+{
+#ifdef HAVE_PERF_EVENTS
+	if (counter_fds[0] < 0)
+		return;
+
+	ioctl(counter_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(counter_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+static void
+counters_stop(result_t *result)
+{
+	result->have_counters = false;
+
+#ifdef HAVE_PERF_EVENTS
+	if (counter_fds[0] < 0)
+		return;
+
+	{
+		int		i;
+
+		ioctl(counter_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+		for (i = 0; i < NCOUNTERS; i++)
+		{
+			uint64	value;
+
+			if (read(counter_fds[i], &value, sizeof(value)) != sizeof(value))
+				return;
+
+			result->counters[i] = value;
+		}
+
+		result->have_counters = true;
+	}
+#endif
+}
+
+#define MEASURE(result, code) \
+	do { \
+		double	start_; \
+		counters_start(); \
+		start_ = now_ns(); \
+		code; \
+		(result)->ns = now_ns() - start_; \
+		counters_stop(result); \
+	} while (0)
+
+/* one run of all the phases for the kind of items and the values */
+static void
+run(const kind_t *kind, uint64 *values, uint32 n, result_t *results)
+{
+	element_set_t  *eset;
+	Size			itemlen;
+	char		   *half1;
+	char		   *half2;
+	char		   *out;
+	char		   *end;
+	uint32			n1,
+					n2,
+					nmerged,
+					nitems;
+
+	eset = build_items(kind, values, n);
+	itemlen = eset->itemlen;
+
+	/* two halves of the unsorted items, like two sets to merge */
+	half1 = xmalloc(n * itemlen);
+	half2 = xmalloc(n * itemlen);
+
+	memcpy(half1, eset->data, (n / 2) * itemlen);
+	memcpy(half2, eset->data + (n / 2) * itemlen, (n - n / 2) * itemlen);
+
+	MEASURE(&results[0], sort_all(eset, eset->data, n));
+
+	MEASURE(&results[1], nitems = dedup_sorted(eset, eset->data, n));
+
+	out = xmalloc(n * itemlen);
+
+	qsort_arg(half1, n / 2, itemlen, get_compare_func(eset), eset);
+	qsort_arg(half2, n - n / 2, itemlen, get_compare_func(eset), eset);
+
+	n1 = dedup_sorted(eset, half1, n / 2);
+	n2 = dedup_sorted(eset, half2, n - n / 2);
+
+	MEASURE(&results[2], end = merge_all(eset, half1, n1, half2, n2, out));
+
+	nmerged = (end - out) / itemlen;
+
+	/* in place, with the first half at the beginning of the output */
+	memcpy(out, half1, n1 * itemlen);
+
+	MEASURE(&results[3],
+			end = merge_items_backward(eset, out, out + n1 * itemlen,
+									   half2, half2 + n2 * itemlen,
+									   out + (n1 + n2) * itemlen, 0));
+
+	if ((nmerged != nitems) ||
+		((out + (n1 + n2) * itemlen - end) / itemlen != nitems))
+	{
+		fprintf(stderr, "merge produced %u / %u items, expected %u\n", nmerged,
+				(uint32) ((out + (n1 + n2) * itemlen - end) / itemlen), nitems);
+		exit(1);
+	}
+
+	free(half1);
+	free(half2);
+	free(out);
+
+	/* pack the deduplicated items (and their values) */
+	eset->nall = eset->nsorted = nitems;
+
+	out = xmalloc(nitems * itemlen +
+				  ((kind->typlen == -1) ? packed_arena_size(eset) : 0));
+
+	MEASURE(&results[4], pack_items(eset, out, out + nitems * itemlen));
+
+	/* use the packed items, so that the copy is not optimized away */
+	sink += out[(nitems - 1) * itemlen];
+
+	free(out);
+	free_items(eset);
+}
+
+static int
+compare_results(const void *a, const void *b)
+{
+	double	da = ((const result_t *) a)->ns;
+	double	db = ((const result_t *) b)->ns;
+
+	return (da > db) - (da < db);
+}
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr,
+			"usage: %s [-n values] [-r repeats] [-t typlen] [-d dist] [-j threads] [-P]\n"
+			"  -n  number of values (default 1000000)\n"
+			"  -r  number of runs, the median is reported (default 5)\n"
+			"  -t  only items of this typlen (1, 2, 4, 8, 16, -1 for varlena)\n"
+			"  -d  only this distribution (uniform, zipf, sorted, duplicate)\n"
+			"  -j  threads used to sort and merge (default 1)\n"
+			"  -P  don't collect hardware counters\n",
+			progname);
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	uint32	n = 1000000;
+	int		nruns = 5;
+	int		only_typlen = 0;
+	int		only_dist = -1;
+	bool	use_counters = true;
+	bool	have_counters;
+	int		c;
+	int		d;
+	int		k;
+	int		p;
+	int		r;
+	result_t *results;
+
+	while ((c = getopt(argc, argv, "n:r:t:d:j:P")) != -1)
+	{
+		switch (c)
+		{
+			case 'n':
+				n = strtoul(optarg, NULL, 10);
+				break;
+			case 'r':
+				nruns = atoi(optarg);
+				break;
+			case 't':
+				only_typlen = atoi(optarg);
+				break;
+			case 'd':
+				for (d = 0; d <= DIST_DUPLICATE; d++)
+					if (strcmp(optarg, dist_names[d]) == 0)
+						only_dist = d;
+				if (only_dist == -1)
+					usage(argv[0]);
+				break;
+			case 'j':
+				nthreads = atoi(optarg);
+				break;
+			case 'P':
+				use_counters = false;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if ((n < 2) || (nruns < 1) || (nthreads < 1) || (nthreads > MAX_KERNEL_THREADS))
+		usage(argv[0]);
+
+	have_counters = use_counters && counters_open();
+
+	results = xmalloc(sizeof(result_t) * NPHASES * nruns);
+
+	printf("%-6s %-10s %-10s %10s", "typlen", "dist", "phase", "ns/value");
+	if (have_counters)
+		for (c = 0; c < NCOUNTERS; c++)
+			printf(" %14s", counter_names[c]);
+	printf("\n");
+
+	for (d = 0; d <= DIST_DUPLICATE; d++)
+	{
+		uint64 *values;
+
+		if ((only_dist != -1) && (only_dist != d))
+			continue;
+
+		values = generate_values(d, n);
+
+		for (k = 0; k < (int) (sizeof(kinds) / sizeof(kinds[0])); k++)
+		{
+			if (only_typlen && (only_typlen != kinds[k].typlen))
+				continue;
+
+			for (r = 0; r < nruns; r++)
+				run(&kinds[k], values, n, &results[r * NPHASES]);
+
+			/* median of each phase (counters of the same run), per value */
+			for (p = 0; p < NPHASES; p++)
+			{
+				result_t   *phase = xmalloc(sizeof(result_t) * nruns);
+				result_t   *median;
+
+				for (r = 0; r < nruns; r++)
+					phase[r] = results[r * NPHASES + p];
+
+				qsort(phase, nruns, sizeof(result_t), compare_results);
+				median = &phase[nruns / 2];
+
+				printf("%-6d %-10s %-10s %10.2f", kinds[k].typlen,
+					   dist_names[d], phase_names[p], median->ns / n);
+
+				if (have_counters && median->have_counters)
+					for (c = 0; c < NCOUNTERS; c++)
+						printf(" %14.3f", (double) median->counters[c] / n);
+
+				printf("\n");
+
+				free(phase);
+			}
+		}
+
+		free(values);
+	}
+
+	free(results);
+
+	return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * check_kernels.c - checks of the element_set kernels on data arrays larger
+ * than 4GB
+ *
+ * The data array may grow past MaxAllocSize (it's allocated as huge), so the
+ * offsets of items need to be computed as Size, not as uint32 * int16. That
+ * can't be checked by the regression tests (it would need gigabytes of
+ * values), so this runs the kernels on an array mapped without reserving
+ * memory - all items are zero (so reading them only maps the zero page),
+ * except for the last one, which has to be found by the kernels.
+ *
+ * Usage: check_kernels (exits with status 1 when a check fails)
+ */
+#include "pg_shim.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "../../element_set.h"
+
+/* more than 4GB of items */
+#define CHECK_SIZE		((Size) 4 * 1024 * 1024 * 1024 + 64 * 1024)
+
+static int	nfailed = 0;
+
+static void
+check(const char *name, bool ok)
+{
+	printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+
+	if (!ok)
+		nfailed++;
+}
+
+static char *
+map_items(void)
+{
+	char   *data = mmap(NULL, CHECK_SIZE, PROT_READ | PROT_WRITE,
+						MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	if (data == MAP_FAILED)
+	{
+		perror("mmap");
+		exit(1);
+	}
+
+	return data;
+}
+
+/* items of a fixed-length type, all equal except for the last one */
+static void
+check_fixed(void)
+{
+	element_set_t	eset;
+	uint32	nitems = CHECK_SIZE / sizeof(int64);
+	int64	last = 1;
+	char   *data = map_items();
+
+	memset(&eset, 0, sizeof(eset));
+	eset.typlen = sizeof(int64);
+	eset.itemlen = sizeof(int64);
+	eset.keykind = KEY_SIGNED;
+	eset.typalign = 'd';
+	eset.data = data;
+	eset.nall = eset.nsorted = nitems;
+
+	memcpy(data + (Size) (nitems - 1) * eset.itemlen, &last, sizeof(int64));
+
+	check("items_lower_bound (int8)",
+		  items_lower_bound(&eset, data, nitems, (char *) &last) == nitems - 1);
+
+	check("dedup_sorted (int8)",
+		  (dedup_sorted(&eset, data, nitems) == 2) &&
+		  (memcmp(data + eset.itemlen, &last, sizeof(int64)) == 0));
+
+	munmap(data, CHECK_SIZE);
+}
+
+/* varlena items, all referencing the same (empty) value except the last one */
+static void
+check_varlena(void)
+{
+	element_set_t	eset;
+	varlena_item_t	item;
+	uint32	nitems = CHECK_SIZE / sizeof(varlena_item_t);
+	char	arena[16];
+	char   *data = map_items();
+
+	memset(&eset, 0, sizeof(eset));
+	eset.typlen = -1;
+	eset.itemlen = sizeof(varlena_item_t);
+	eset.keykind = KEY_VARLENA;
+	eset.typalign = 'i';
+	eset.data = data;
+	eset.arena = arena;
+	eset.nall = eset.nsorted = nitems;
+
+	memset(arena, 0, sizeof(arena));
+	memcpy(VARDATA(arena + 8), "abc", 3);
+
+	item.hash = 1;
+	item.offset = 8;
+	item.length = 3;
+
+	memcpy(data + (Size) (nitems - 1) * eset.itemlen, &item, sizeof(item));
+
+	check("packed_arena_size (varlena)",
+		  packed_arena_size(&eset) == (Size) nitems * VARHDRSZ + 3);
+
+	check("dedup_sorted (varlena)",
+		  (dedup_sorted(&eset, data, nitems) == 2) &&
+		  (memcmp(data + eset.itemlen, &item, sizeof(item)) == 0));
+
+	munmap(data, CHECK_SIZE);
+}
+
+int
+main(void)
+{
+	if (sizeof(Size) < 8)
+	{
+		printf("skipped (32-bit platform)\n");
+		return 0;
+	}
+
+	check_fixed();
+	check_varlena();
+
+	return (nfailed > 0) ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * pg_shim.h - the few definitions from c.h/postgres.h needed by element_set.h
+ *
+ * Only what the kernels use, with the same meaning as in PostgreSQL, so that
+ * they can be compiled without the server headers.
+ */
+#ifndef PG_SHIM_H
+#define PG_SHIM_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+typedef int16_t int16;
+typedef int32_t int32;
+typedef int64_t int64;
+typedef float float4;
+typedef double float8;
+typedef size_t Size;
+
+#define UINT64CONST(x)	UINT64_C(x)
+
+#define Assert(condition)	assert(condition)
+#define PG_USED_FOR_ASSERTS_ONLY __attribute__((unused))
+
+#define Min(x, y)		((x) < (y) ? (x) : (y))
+#define Max(x, y)		((x) > (y) ? (x) : (y))
+
+/* values in the arena always have the 4B varlena header */
+#define VARHDRSZ		((int32) sizeof(int32))
+#define VARDATA(PTR)	(((char *) (PTR)) + VARHDRSZ)
+
+#define TYPEALIGN(ALIGNVAL,LEN)  \
+	(((uintptr_t) (LEN) + ((ALIGNVAL) - 1)) & ~((uintptr_t) ((ALIGNVAL) - 1)))
+
+#define MAXALIGN(LEN)	TYPEALIGN(8, (LEN))
+
+#define att_align_nominal(cur_offset, attalign) \
+( \
+	((attalign) == 'i') ? TYPEALIGN(4, (cur_offset)) : \
+	 (((attalign) == 'c') ? (uintptr_t) (cur_offset) : \
+	  (((attalign) == 'd') ? TYPEALIGN(8, (cur_offset)) : \
+		TYPEALIGN(2, (cur_offset)))) \
+)
+
+typedef int (*qsort_arg_comparator) (const void *a, const void *b, void *arg);
+
+/*
+ * PostgreSQL has its own qsort_arg (in src/port), glibc qsort_r has the same
+ * signature of the comparator, so use that (the algorithms differ, so the
+ * sort timings are indicative only)
+ */
+#define qsort_arg(base, nel, elsize, cmp, arg)	qsort_r(base, nel, elsize, cmp, arg)
+
+#endif							/* PG_SHIM_H */
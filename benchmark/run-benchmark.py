@@ -0,0 +1,447 @@
+#!/usr/bin/env python3
+#
+# run-benchmark.py - run the SQL benchmarks in a throwaway cluster
+#
+# Creates a temporary cluster (using initdb/pg_ctl of the installation given
+# by pg_config, which also needs to have the extension installed), loads the
+# datasets from create-tables.sql, and then runs each query of
+# bench-native.sql and bench-count-distinct.sql repeatedly, both serial
+# and parallel. For each query it records the median / min / max duration,
+# peak RSS of the backend (VmHWM, Linux only) and the memory reported by
+# EXPLAIN ANALYZE (hash aggregate / sort nodes), and writes the results as
+# JSON and CSV.
+#
+# The results may be compared with a saved baseline (e.g. results of the
+# previous release), either right after the run (--baseline) or later:
+#
+#   ./run-benchmark.py --scale small --runs 5 --output results/new
+#   ./run-benchmark.py --compare results/old/results.json results/new/results.json
+#
+# The datasets are the sections of create-tables.sql starting with a line
+# "-- NAME DATASET", the queries are the lines following "\echo NAME QUERY n"
+# in the benchmark scripts (the repeated copies are ignored).
+
+import argparse
+import csv
+import json
+import os
+import re
+import shutil
+import socket
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCHMARK_DIR = os.path.dirname(os.path.abspath(__file__))
+
+VARIANTS = {
+    'native': 'bench-native.sql',
+    'count_distinct': 'bench-count-distinct.sql',
+}
+
+MARKER = '__count_distinct_benchmark__'
+
+CSV_FIELDS = ['scale', 'query', 'variant', 'mode', 'runs', 'median_ms', 'min_ms',
+              'max_ms', 'peak_rss_kb', 'plan_memory_kb', 'plan_disk_kb', 'sql']
+
+
+def parse_datasets(path):
+    """split create-tables.sql into sections by the DATASET comments"""
+    datasets = {}
+    name = None
+
+    with open(path) as f:
+        for line in f:
+            m = re.match(r'--\s*(\w+)\s+DATASET', line)
+            if m:
+                name = m.group(1).lower()
+                datasets[name] = []
+            elif name is not None:
+                datasets[name].append(line)
+
+    return {name: ''.join(lines) for name, lines in datasets.items()}
+
+
+def parse_queries(path):
+    """queries of a benchmark script, as a list of (scale, number, sql)"""
+    queries = []
+    current = None
+
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+
+            m = re.match(r'\\echo\s+(\w+)\s+QUERY\s+(\d+)', line)
+            if m:
+                current = (m.group(1).lower(), int(m.group(2)))
+            elif current is not None and line.upper().startswith('SELECT'):
+                queries.append((current[0], current[1], line))
+                current = None
+
+    return queries
+
+
+class Cluster:
+    """temporary cluster, listening only on a unix socket"""
+
+    def __init__(self, bindir, settings, keep=False):
+        self.bindir = bindir
+        self.keep = keep
+        self.basedir = tempfile.mkdtemp(prefix='count_distinct_bench.')
+        self.datadir = os.path.join(self.basedir, 'data')
+        self.port = free_port()
+
+        run([self.binary('initdb'), '-D', self.datadir, '-A', 'trust', '-N',
+             '-U', 'postgres'])
+
+        with open(os.path.join(self.datadir, 'postgresql.conf'), 'a') as f:
+            f.write("\nlisten_addresses = ''\n")
+            f.write("unix_socket_directories = '%s'\n" % self.basedir)
+            f.write("port = %d\n" % self.port)
+            for setting in settings:
+                f.write('%s\n' % setting)
+
+        run([self.binary('pg_ctl'), '-D', self.datadir, '-w', '-l',
+             os.path.join(self.basedir, 'postgresql.log'), 'start'])
+
+    def binary(self, name):
+        return os.path.join(self.bindir, name)
+
+    def psql_args(self):
+        return [self.binary('psql'), '-X', '-h', self.basedir, '-p', str(self.port),
+                '-U', 'postgres', '-d', 'postgres']
+
+    def execute(self, sql):
+        run(self.psql_args() + ['-q', '-v', 'ON_ERROR_STOP=1'], input=sql)
+
+    def stop(self):
+        run([self.binary('pg_ctl'), '-D', self.datadir, '-m', 'fast', 'stop'])
+
+        if self.keep:
+            print('keeping the cluster in %s' % self.basedir, file=sys.stderr)
+        else:
+            shutil.rmtree(self.basedir)
+
+
+class Session:
+    """
+    psql running in the background, so that all the runs of a query happen
+    in the same backend (and we can look at its memory usage)
+    """
+
+    def __init__(self, cluster):
+        self.errors = tempfile.TemporaryFile(mode='w+')
+        self.proc = subprocess.Popen(cluster.psql_args() + ['-q', '-A', '-t',
+                                                            '-v', 'ON_ERROR_STOP=1'],
+                                     stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                     stderr=self.errors, universal_newlines=True,
+                                     bufsize=1)
+
+    def query(self, sql):
+        """run the statement, and return its output (without the marker)"""
+        self.proc.stdin.write('%s;\n\\echo %s\n' % (sql.rstrip().rstrip(';'), MARKER))
+        self.proc.stdin.flush()
+
+        lines = []
+        while True:
+            line = self.proc.stdout.readline()
+
+            if line == '':
+                self.errors.seek(0)
+                raise RuntimeError('query failed: %s\n%s' % (sql, self.errors.read()))
+
+            if line.rstrip('\n') == MARKER:
+                return ''.join(lines).rstrip('\n')
+
+            lines.append(line)
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.wait()
+        self.errors.close()
+
+
+def run(args, input=None):
+    subprocess.run(args, input=input, universal_newlines=True, check=True,
+                   stdout=subprocess.DEVNULL)
+
+
+def free_port():
+    s = socket.socket()
+    s.bind(('127.0.0.1', 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+
+def peak_rss(pid):
+    """peak RSS of the backend (kB), or None when not available"""
+    try:
+        with open('/proc/%d/status' % pid) as f:
+            for line in f:
+                if line.startswith('VmHWM:'):
+                    return int(line.split()[1])
+    except OSError:
+        pass
+
+    return None
+
+
+def plan_memory(node):
+    """
+    largest memory usage of a node (hash aggregate or in-memory sort), and
+    the total disk usage (spilled hash aggregates, external sorts), in kB,
+    including the parallel workers
+    """
+    memory = 0
+    disk = 0
+
+    for info in [node] + node.get('Workers', []):
+        memory = max(memory, info.get('Peak Memory Usage', 0))
+        disk += info.get('Disk Usage', 0)
+
+        if info.get('Sort Space Type') == 'Memory':
+            memory = max(memory, info.get('Sort Space Used', 0))
+        elif info.get('Sort Space Type') == 'Disk':
+            disk += info.get('Sort Space Used', 0)
+
+    for child in node.get('Plans', []):
+        (m, d) = plan_memory(child)
+        memory = max(memory, m)
+        disk += d
+
+    return (memory, disk)
+
+
+def run_query(cluster, sql, settings, runs, warmup):
+    session = Session(cluster)
+
+    try:
+        pid = int(session.query('SELECT pg_backend_pid()'))
+
+        for setting in settings:
+            session.query('SET %s' % setting)
+
+        for i in range(warmup):
+            session.query(sql)
+
+        durations = []
+        for i in range(runs):
+            start = time.perf_counter()
+            session.query(sql)
+            durations.append((time.perf_counter() - start) * 1000.0)
+
+        # memory of the nodes (a separate run, the instrumentation is not free)
+        plan = json.loads(session.query('EXPLAIN (ANALYZE, TIMING OFF, FORMAT JSON) ' + sql))
+        (memory, disk) = plan_memory(plan[0]['Plan'])
+
+        rss = peak_rss(pid)
+    finally:
+        session.close()
+
+    return {
+        'runs': runs,
+        'median_ms': round(statistics.median(durations), 3),
+        'min_ms': round(min(durations), 3),
+        'max_ms': round(max(durations), 3),
+        'peak_rss_kb': rss,
+        'plan_memory_kb': memory,
+        'plan_disk_kb': disk,
+    }
+
+
+def benchmark(args):
+    datasets = parse_datasets(os.path.join(BENCHMARK_DIR, 'create-tables.sql'))
+
+    for scale in args.scale:
+        if scale not in datasets:
+            sys.exit('unknown dataset "%s" (available: %s)' % (scale, ', '.join(datasets)))
+
+    bindir = subprocess.check_output([args.pg_config, '--bindir'],
+                                     universal_newlines=True).strip()
+
+    modes = {
+        'serial': ['max_parallel_workers_per_gather = 0'],
+        'parallel': ['max_parallel_workers_per_gather = %d' % args.workers],
+    }
+
+    cluster = Cluster(bindir, args.setting, keep=args.keep)
+    results = []
+
+    try:
+        cluster.execute('CREATE EXTENSION count_distinct;')
+
+        for scale in args.scale:
+            print('loading %s dataset' % scale, file=sys.stderr)
+            cluster.execute(datasets[scale])
+            cluster.execute('VACUUM ANALYZE;')
+
+        session = Session(cluster)
+        version = session.query('SELECT version()')
+        extversion = session.query("SELECT extversion FROM pg_extension WHERE extname = 'count_distinct'")
+        session.close()
+
+        for variant in args.variant:
+            queries = parse_queries(os.path.join(BENCHMARK_DIR, VARIANTS[variant]))
+
+            for (scale, number, sql) in queries:
+                if scale not in args.scale:
+                    continue
+
+                for mode in args.mode:
+                    result = run_query(cluster, sql, modes[mode], args.runs, args.warmup)
+                    result.update({'scale': scale, 'query': number, 'variant': variant,
+                                   'mode': mode, 'sql': sql})
+                    results.append(result)
+
+                    print('%-8s %3d %-15s %-9s %10.1f ms' % (scale, number, variant, mode,
+                                                             result['median_ms']),
+                          file=sys.stderr)
+    finally:
+        cluster.stop()
+
+    output = {
+        'date': time.strftime('%Y-%m-%d %H:%M:%S'),
+        'server_version': version,
+        'extension_version': extversion,
+        'settings': args.setting,
+        'workers': args.workers,
+        'results': results,
+    }
+
+    os.makedirs(args.output, exist_ok=True)
+
+    with open(os.path.join(args.output, 'results.json'), 'w') as f:
+        json.dump(output, f, indent=2)
+
+    with open(os.path.join(args.output, 'results.csv'), 'w', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=CSV_FIELDS)
+        writer.writeheader()
+        for result in results:
+            writer.writerow(result)
+
+    print('results written to %s' % args.output, file=sys.stderr)
+
+    return os.path.join(args.output, 'results.json')
+
+
+def result_key(result):
+    return (result['scale'], result['query'], result['variant'], result['mode'])
+
+
+def compare(baseline_path, current_path, threshold):
+    """
+    print the changes of durations and memory usage compared to the baseline,
+    and return the number of regressions (changes over the threshold)
+    """
+    with open(baseline_path) as f:
+        baseline = {result_key(r): r for r in json.load(f)['results']}
+
+    with open(current_path) as f:
+        current = json.load(f)['results']
+
+    regressions = 0
+
+    print('%-8s %5s %-15s %-9s %11s %11s %8s %10s %10s %8s  %s' % (
+        'scale', 'query', 'variant', 'mode', 'base ms', 'new ms', 'change',
+        'base rss', 'new rss', 'change', ''))
+
+    for result in current:
+        base = baseline.get(result_key(result))
+
+        if base is None:
+            continue
+
+        time_change = result['median_ms'] / base['median_ms'] - 1.0 if base['median_ms'] else 0.0
+
+        if base['peak_rss_kb'] and result['peak_rss_kb']:
+            rss_change = result['peak_rss_kb'] / base['peak_rss_kb'] - 1.0
+        else:
+            rss_change = 0.0
+
+        flags = []
+        if time_change > threshold:
+            flags.append('SLOWER')
+        elif time_change < -threshold:
+            flags.append('faster')
+
+        if rss_change > threshold:
+            flags.append('MORE MEMORY')
+        elif rss_change < -threshold:
+            flags.append('less memory')
+
+        if time_change > threshold or rss_change > threshold:
+            regressions += 1
+
+        print('%-8s %5d %-15s %-9s %11.1f %11.1f %+7.1f%% %10s %10s %+7.1f%%  %s' % (
+            result['scale'], result['query'], result['variant'], result['mode'],
+            base['median_ms'], result['median_ms'], time_change * 100,
+            base['peak_rss_kb'], result['peak_rss_kb'], rss_change * 100,
+            ' '.join(flags)))
+
+    missing = set(baseline) - set(result_key(r) for r in current)
+    if missing:
+        print('%d results of the baseline not in the current run' % len(missing))
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Run the count_distinct SQL benchmarks.')
+    parser.add_argument('--pg-config', default='pg_config',
+                        help='pg_config of the installation to use (default: pg_config)')
+    parser.add_argument('--scale', action='append', default=None,
+                        help='dataset to use (small, medium, large), may be repeated (default: small)')
+    parser.add_argument('--variant', action='append', choices=sorted(VARIANTS), default=None,
+                        help='queries to run, may be repeated (default: both)')
+    parser.add_argument('--mode', action='append', choices=['serial', 'parallel'], default=None,
+                        help='run the queries serial or parallel, may be repeated (default: both)')
+    parser.add_argument('--runs', type=int, default=5,
+                        help='number of runs of each query (default: 5)')
+    parser.add_argument('--warmup', type=int, default=1,
+                        help='runs before the measured ones (default: 1)')
+    parser.add_argument('--workers', type=int, default=4,
+                        help='max_parallel_workers_per_gather for parallel runs (default: 4)')
+    parser.add_argument('--setting', action='append', default=[],
+                        help='additional server setting, e.g. "work_mem = \'64MB\'"')
+    parser.add_argument('--output', default=os.path.join(BENCHMARK_DIR, 'results',
+                                                         time.strftime('%Y%m%d-%H%M%S')),
+                        help='directory for results.json and results.csv')
+    parser.add_argument('--keep', action='store_true',
+                        help='keep the cluster (and the server log) after the run')
+    parser.add_argument('--baseline',
+                        help='compare the results with a baseline (results.json)')
+    parser.add_argument('--compare', nargs=2, metavar=('BASELINE', 'CURRENT'),
+                        help='only compare two existing results, without running anything')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='change (in %%) reported as regression (default: 10)')
+    parser.add_argument('--fail-on-regression', action='store_true',
+                        help='exit with status 2 if there are regressions')
+
+    args = parser.parse_args()
+
+    if args.compare:
+        (baseline, current) = args.compare
+    else:
+        args.scale = args.scale or ['small']
+        args.variant = args.variant or ['native', 'count_distinct']
+        args.mode = args.mode or ['serial', 'parallel']
+
+        current = benchmark(args)
+        baseline = args.baseline
+
+    if baseline is None:
+        return 0
+
+    regressions = compare(baseline, current, args.threshold / 100.0)
+
+    if regressions and args.fail_on_regression:
+        return 2
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -7,20 +7,59 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
-#include <sys/time.h>
 #include <unistd.h>
 #include <limits.h>
 
 #include "postgres.h"
+#include "funcapi.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
 #include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/jsonb.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/sortsupport.h"
+#include "utils/typcache.h"
 #include "access/tupmacs.h"
+#include "libpq/pqformat.h"
+#include "portability/instr_time.h"
+
+#include "element_set.h"
+
+/*
+ * static probes (see probes.d), generated by dtrace when built with
+ * ENABLE_DTRACE=1, and compiled to nothing otherwise
+ */
+#ifdef ENABLE_DTRACE
+#include "probes.h"
+#else
+#define TRACE_COUNT_DISTINCT_COMPACT_START(INT1, INT2, INT3, INT4) do {} while (0)
+#define TRACE_COUNT_DISTINCT_COMPACT_DONE(INT1, INT2) do {} while (0)
+#define TRACE_COUNT_DISTINCT_MERGE_START(INT1, INT2, INT3) do {} while (0)
+#define TRACE_COUNT_DISTINCT_MERGE_DONE(INT1) do {} while (0)
+#define TRACE_COUNT_DISTINCT_RESIZE_START(INT1, INT2, INT3) do {} while (0)
+#define TRACE_COUNT_DISTINCT_RESIZE_DONE(INT1, INT2) do {} while (0)
+#define TRACE_COUNT_DISTINCT_COMBINE_START(INT1, INT2, INT3) do {} while (0)
+#define TRACE_COUNT_DISTINCT_COMBINE_DONE(INT1) do {} while (0)
+#define TRACE_COUNT_DISTINCT_SERIAL_START(INT1, INT2) do {} while (0)
+#define TRACE_COUNT_DISTINCT_SERIAL_DONE(INT1) do {} while (0)
+#define TRACE_COUNT_DISTINCT_DESERIAL_START(INT1) do {} while (0)
+#define TRACE_COUNT_DISTINCT_DESERIAL_DONE(INT1, INT2) do {} while (0)
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2_INTERSECT
+#endif
 
 PG_MODULE_MAGIC;
 
-/* if set to 1, the table resize will be profiled */
-#define DEBUG_PROFILE	   0
+#if PG_VERSION_NUM < 110000
+#define pq_sendint16(buf, i)	pq_sendint(buf, i, 2)
+#define pq_sendint32(buf, i)	pq_sendint(buf, i, 4)
+#endif
 
 #define GET_AGG_CONTEXT(fname, fcinfo, aggcontext)  \
 	if (! AggCheckCallContext(fcinfo, &aggcontext)) {   \
@@ -33,98 +72,268 @@ PG_MODULE_MAGIC;
 	}
 
 /*
- * This count_distinct implementation uses a simple, partially sorted array.
- *
- * It's considerably simpler than the hash-table based version, and the main
- * goals of this design is to:
- *
- * (a) minimize the palloc overhead - the whole array is allocated as a whole,
- *	 and thus has a single palloc header (while in the hash table, each
- *	 bucket had at least one such header)
- *
- * (b) optimal L2/L3 cache utilization - once the hash table can't fit into
- *	 the CPU caches, it get's considerably slower because of cache misses,
- *	 and it's impossible to improve the hash implementation (because for
- *	 large hash tables it naturally leads to cache misses)
- *
- * Hash tables are great when you need to immediately query the structure
- * (e.g. to immediately check whether the key is already in the table), but
- * in count_distint it's not really necessary. We can accumulate some elements
- * first (into a buffer), and then process all of them at once - this approach
- * improves the CPU cache hit ratios. Also, the palloc overhead is much lower.
- *
- * The data array is split into three sections - sorted items, unsorted items,
- * and unused.
- *
- *     ----------------------------------------------
- *     |    sorted    |    unsorted    |    free    |
- *     ----------------------------------------------
- *
- * Initially, the sorted / unsorted sections are empty, of course.
- *
- *     ----------------------------------------------
- *     |                    free                    |
- *     ----------------------------------------------
+ * header of the serialized state (followed by the items and the arena)
  *
- * New values are simply accumulated into the unsorted section, which grows.
- *
- *     ----------------------------------------------
- *     |          unsorted  -->       |     free    |
- *     ----------------------------------------------
+ * We don't copy the element_set_t struct, as most of it is irrelevant in
+ * the serialized form (pointers, sizes of allocated memory) and it would
+ * be a significant overhead for states with just a couple of items.
+ */
+typedef struct serial_header_t
+{
+	uint32	nall;		/* number of items (sorted, without duplicates) */
+	uint32	arena_used;	/* bytes of the arena (packed, 0 for fixed-length) */
+	int16	typlen;
+	int16	itemlen;
+	char	typalign;
+	char	keykind;
+	uint8	version;	/* format version (SERIAL_FORMAT_VERSION) */
+	uint8	flags;		/* SERIAL_COUNTED or zero */
+	int32	argument;	/* argument (for counted sets) */
+} serial_header_t;
+
+#define SERIAL_FORMAT_VERSION	1
+
+/*
+ * byte order of the values in the external format of distinct_set - keys
+ * in network byte order, or values in the native byte order (see write_set)
+ */
+#define EXTERNAL_ORDER_NETWORK	'n'
+#define EXTERNAL_ORDER_BIG		'b'
+#define EXTERNAL_ORDER_LITTLE	'l'
+
+#ifdef WORDS_BIGENDIAN
+#define EXTERNAL_ORDER_NATIVE	EXTERNAL_ORDER_BIG
+#else
+#define EXTERNAL_ORDER_NATIVE	EXTERNAL_ORDER_LITTLE
+#endif
+
+/* the items include counts */
+#define SERIAL_COUNTED			0x01
+
+/*
+ * information about the element type, cached in fn_extra of the transition
+ * function - the argument type is fixed for each call site, so we do the
+ * catalog lookups only once and not for each row (or each group)
+ */
+typedef struct element_info_t
+{
+	Oid		element_type;	/* type of the values (or array elements) */
+	int16	typlen;
+	bool	typbyval;
+	char	typalign;
+	char	keykind;		/* how to transform the values into keys */
+} element_info_t;
+
+/*
+ * information about the arguments of the multi-column variants, cached in
+ * fn_extra - the values are packed into a single composite key, described
+ * by info (used to initialize the set, just like for a single column)
  *
- * Once there's no more space for new items, the unsorted items are 'compacted'
- * which means the values are sorted, duplicates are removed and the result
- * is merged into the sorted section (unless it's empty). The 'merge' is just
- * a simple 'merge-sort' of the two sorted inputs, with removal of duplicates.
+ * When all columns are passed by value and fit into a Datum, the key is an
+ * unsigned integer with the keys of the columns in the order of arguments.
+ * Otherwise the key is binary, with the keys of columns passed by value in
+ * big-endian byte order (so that memcmp compares the columns in order), and
+ * padded to 16 bytes (to use the specialized comparator) when shorter.
+ */
+typedef struct composite_info_t
+{
+	element_info_t	info;		/* the composite key */
+	char		   *key;		/* buffer for binary keys */
+	int				ncolumns;
+	element_info_t	columns[FLEXIBLE_ARRAY_MEMBER];
+} composite_info_t;
+
+/*
+ * state of count_distinct_state_info - a regular set, and the number of
+ * non-NULL values added to it (so that we can report the ratio without
+ * making the common states larger)
+ */
+typedef struct state_info_t
+{
+	element_set_t  *eset;
+	int64			nvalues;
+} state_info_t;
+
+/*
+ * With many groups (e.g. HashAggregate with a lot of small groups) most of
+ * the states only contain a couple of items, and allocating the header, the
+ * initial data array and the arena separately would be quite wasteful (each
+ * palloc chunk has a header, and AllocSet rounds the sizes to powers of 2).
  *
- * Once the compaction completes, it's checked whether enough space was freed,
- * where 'enough' means ~20% of the array needs to be free. Using low values
- * (e.g. space for at least one value) might cause 'oscillation' - imagine
- * compaction that removes a single item, causing compaction on the very next
- * addition. Using non-trivial threshold (like the 20%) should prevent such
- * frequent compactions - which is quite expensive operation.
+ * So we carve new states (the header with the initial data array and arena)
+ * from larger blocks allocated in the aggregate context, which keeps tiny
+ * states packed densely. The parts allocated this way are marked in flags,
+ * and when the data array or arena need to grow, we simply allocate them
+ * as regular chunks (the small initial part gets wasted, but that does not
+ * matter for states large enough to grow).
  *
- * If there's not enough free space, the array grows (twice the size).
+ * The blocks are owned by the aggregate context, so there's one allocator
+ * for each context, with a reset callback forgetting the allocator when the
+ * context gets reset (e.g. after each group in GroupAggregate) or deleted.
  *
- * The compaction needs to be performed at the very end, when computing the
- * actual result of the aggregate (distinct value in the array).
+ * All memory used by the states (blocks, data arrays and arenas) is charged
+ * to the allocator of the context, and to a per-backend total, which allows
+ * enforcing the count_distinct.max_memory limit. The memory itself is still
+ * allocated in the aggregate context, so the executor sees it too (e.g. on
+ * PostgreSQL 13+ the hash aggregate accounting, which may spill to disk).
  */
-typedef struct element_set_t
+typedef struct state_allocator_t
 {
-	/* aggregation memory context (so we don't need to do lookups repeatedly) */
-	MemoryContext	aggctx;
+	MemoryContext	ctx;		/* aggregate context the blocks belong to */
+	char		   *ptr;		/* free space in the current block */
+	Size			avail;		/* bytes available in the current block */
+	Size			blksize;	/* size of the next block */
+	Size			allocated;	/* memory charged to this allocator */
 
-	Size	nbytes;		/* size of the data array (number of bytes) */
-	uint32	nsorted;	/* number of items in the sorted part */
-	uint32	nall;		/* number of all items (sorted + unsorted) */
+	struct state_allocator_t *next;	/* allocator for another context */
 
-	/* used for arrays only (cache for get_typlenbyvalalign results) */
-	int16	typlen;
-	bool	typbyval;
-	char	typalign;
+	MemoryContextCallback callback;
+} state_allocator_t;
+
+/* allocators for all aggregate contexts with some states */
+static state_allocator_t *allocators = NULL;
+
+/* memory charged to all allocators in this backend */
+static Size total_allocated = 0;
+
+/* GUC - limit on total_allocated (in kB, -1 means no limit) */
+static int count_distinct_max_memory = -1;
+
+/* GUC - collect the runtime statistics (see count_distinct_stats_t) */
+static bool count_distinct_track_stats = false;
+
+/* GUC - sort large batches of new items in 2^k partitions (see sort_items) */
+static int count_distinct_partition_bits = 0;
+
+/* GUC - threads used to sort and merge large batches of items (see sort_items) */
+static int count_distinct_max_threads = 1;
+
+/*
+ * GUCs - free space required in the data array after compaction, and the
+ * dedup ratios switching to faster / slower growth (see compact_set)
+ */
+static double count_distinct_free_space = ARRAY_FREE_FRACT;
+static double count_distinct_fast_growth_ratio = 0.1;
+static double count_distinct_slow_growth_ratio = 0.5;
+
+/*
+ * Per-backend statistics about the work done on the states, collected only
+ * with count_distinct.track_stats enabled, and returned by the function
+ * count_distinct_stats(). Parallel workers collect their own statistics,
+ * which are not visible in the leader.
+ */
+typedef struct count_distinct_stats_t
+{
+	uint64	compactions;	/* compactions sorting new items */
+	uint64	merges;			/* merges of sorted arrays (compaction, combine) */
+	uint64	sort_time;		/* time spent sorting new items (microseconds) */
+	uint64	bytes_copied;	/* bytes written by merges and copies of states */
+	uint64	reallocations;	/* resizes of data arrays and arenas */
+	uint64	peak_state_size;	/* largest state (data array and arena) */
+	uint64	combine_calls;
+	uint64	combine_bytes;	/* size of the states merged by combine */
+	uint64	serial_calls;
+	uint64	serial_bytes;
+	uint64	deserial_calls;
+	uint64	deserial_bytes;
+} count_distinct_stats_t;
+
+static count_distinct_stats_t stats;
+
+#define STATS_ADD(field, value) \
+	do { \
+		if (count_distinct_track_stats) \
+			stats.field += (value); \
+	} while (0)
+
+/* size of the data array and arena of a state */
+#define STATE_SIZE(eset)	((eset)->nbytes + (eset)->arena_size)
+
+#define STATS_PEAK(eset) \
+	do { \
+		if (count_distinct_track_stats && \
+			(STATE_SIZE(eset) > stats.peak_state_size)) \
+			stats.peak_state_size = STATE_SIZE(eset); \
+	} while (0)
+
+/*
+ * Size of the blocks used to allocate new states. We start with small
+ * blocks (when the aggregate context gets reset after each group, we don't
+ * want to allocate a large block for a single state), and double the size
+ * for each new block. States larger than a quarter of the maximum block are
+ * allocated directly.
+ */
+#define STATE_BLOCK_MIN		1024
+#define STATE_BLOCK_MAX		8192
 
-	/* array of elements */
-	char   *data;		/* nsorted items first, then unsorted ones */
-} element_set_t;
+/*
+ * Initial size of the array (in bytes). The array is allocated together
+ * with the element_set_t header (72B), and 64B is enough for 8 items of
+ * the usual fixed-length types (the majority of groups tend to have only
+ * a couple of distinct values) without wasting memory with many groups.
+ */
+#define ARRAY_INIT_SIZE		64
 
 /*
- * Initial size of the array (in bytes). This should be larger than the
- * minimum chunk size, which for AllocSet is 8B. As the element_set_t
- * struct has a fairly significant overhead (~40B) the 32B seems like a
- * reasonable value.
+ * While the data array is the small initial one, items up to this size are
+ * inserted directly into the sorted part (with duplicates discarded), so
+ * small sets never need to be sorted at all (see insert_item).
  */
-#define ARRAY_INIT_SIZE		32
+#define SMALL_ITEM_MAX		16
 
-/* we want >= 20% free space after compaction (mostly arbitrary value) */
+/*
+ * we want >= 20% free space after compaction (mostly arbitrary value), the
+ * data array uses count_distinct.free_space (with this as the default)
+ */
 #define ARRAY_FREE_FRACT	0.2
 
+/*
+ * Weight of the last compaction in the average dedup ratio, deciding how
+ * fast the data array grows (see compact_set). With 1/2 the average follows
+ * changes of the data within a couple compactions (e.g. new values getting
+ * mostly duplicates once all distinct values were seen), while a single
+ * unusual batch does not switch the growth policy back and forth. All the
+ * compactions before the last four contribute only 1/16 together.
+ */
+#define DEDUP_RATIO_WEIGHT	0.5
+
+/* initial size of the arena for variable-length values (in bytes) */
+#define ARENA_INIT_SIZE		128
+
+/*
+ * If one set is this many times smaller than the other one, we look up its
+ * items in the larger one using a galloping search, instead of walking all
+ * items of the larger set.
+ */
+#define GALLOP_RATIO	32
+
+/*
+ * The new items are partitioned before sorting only when there's at least
+ * this many bytes of them - smaller batches fit into the CPU caches anyway.
+ */
+#define PARTITION_MIN_SIZE	(256 * 1024)
+
+/* maximum value of count_distinct.partition_bits (4096 partitions) */
+#define PARTITION_MAX_BITS	12
+
+/*
+ * Multiple threads are used only for batches of at least this many bytes
+ * (starting the threads is not free), and with this many partitions (or
+ * merged chunks) per thread, so that skewed ones don't leave threads idle.
+ */
+#define THREADS_MIN_SIZE	(1024 * 1024)
+#define TASKS_PER_THREAD	8
+
 /*
  * prototypes
  */
 
+void _PG_init(void);
+
 /* transition functions */
 PG_FUNCTION_INFO_V1(count_distinct_append);
 PG_FUNCTION_INFO_V1(count_distinct_elements_append);
+PG_FUNCTION_INFO_V1(count_distinct_multi_append);
 
 /* parallel aggregation support functions */
 PG_FUNCTION_INFO_V1(count_distinct_serial);
@@ -135,24 +344,169 @@ PG_FUNCTION_INFO_V1(count_distinct_combine);
 PG_FUNCTION_INFO_V1(count_distinct);
 PG_FUNCTION_INFO_V1(array_agg_distinct_type_by_element);
 PG_FUNCTION_INFO_V1(array_agg_distinct_type_by_array);
+PG_FUNCTION_INFO_V1(distinct_set_final);
+
+/* distinct_set data type */
+PG_FUNCTION_INFO_V1(distinct_set_in);
+PG_FUNCTION_INFO_V1(distinct_set_out);
+PG_FUNCTION_INFO_V1(distinct_set_recv);
+PG_FUNCTION_INFO_V1(distinct_set_send);
+PG_FUNCTION_INFO_V1(distinct_set_cardinality);
+PG_FUNCTION_INFO_V1(distinct_set_union_append);
+
+/* set operations */
+PG_FUNCTION_INFO_V1(distinct_set_intersect);
+PG_FUNCTION_INFO_V1(distinct_set_jaccard);
+PG_FUNCTION_INFO_V1(array_intersect_distinct);
+PG_FUNCTION_INFO_V1(array_jaccard_distinct);
+
+/* counted sets (multisets) */
+PG_FUNCTION_INFO_V1(count_distinct_counted_append);
+PG_FUNCTION_INFO_V1(count_distinct_min_occurrences);
+PG_FUNCTION_INFO_V1(top_values);
+
+/* runtime statistics */
+PG_FUNCTION_INFO_V1(count_distinct_stats);
+PG_FUNCTION_INFO_V1(count_distinct_stats_reset);
+
+/* introspection of the states */
+PG_FUNCTION_INFO_V1(count_distinct_state_info_append);
+PG_FUNCTION_INFO_V1(count_distinct_state_info);
 
 /* supplementary subroutines */
-static void add_element(element_set_t *eset, char *value);
-static element_set_t *init_set(int16 typlen, bool typbyval, char typalign, MemoryContext ctx);
+static void add_element(element_set_t *eset, Datum value);
+static void insert_item(element_set_t *eset);
+static void add_elements(element_set_t *eset, ArrayType *input, int nelements);
+static bool array_has_values(ArrayType *input, int nelements);
+static void reserve_space(element_set_t *eset, int nitems);
+static element_info_t *get_element_info(FunctionCallInfo fcinfo, bool elements);
+static void lookup_element_info(element_info_t *info, Oid element_type);
+static composite_info_t *get_composite_info(FunctionCallInfo fcinfo);
+static Datum pack_composite(composite_info_t *cinfo, FunctionCallInfo fcinfo);
+static element_set_t *init_set(element_info_t *info, MemoryContext ctx,
+							   bool counted);
+static state_allocator_t *get_allocator(MemoryContext ctx);
+static char *alloc_state(state_allocator_t *alloc, Size size);
+static void release_allocator(void *arg);
+static void *alloc_memory(state_allocator_t *alloc, Size size);
+static void *realloc_memory(state_allocator_t *alloc, void *ptr,
+							Size oldsize, Size newsize);
+static void free_memory(state_allocator_t *alloc, void *ptr, Size size);
+static void charge_memory(state_allocator_t *alloc, Size size);
+static void resize_data(element_set_t *eset, Size nbytes);
+static void free_data(element_set_t *eset);
 static element_set_t *copy_set(element_set_t *eset);
-
-static int compare_items(const void *a, const void *b, void *size);
+static const char *key_kind_name(char keykind);
+static bytea *serialize_set(element_set_t *eset);
+static element_set_t *deserialize_set(bytea *state);
+static void merge_sets(element_set_t *eset1, element_set_t *eset2);
+static void append_set(element_set_t *eset, element_set_t *other);
+static void check_compatible(element_set_t *eset1, element_set_t *eset2);
+static void write_set(StringInfo buf, bytea *value);
+static bytea *read_set(StringInfo buf);
+static int hex_value(char c);
+static void set_from_value(element_set_t *eset, bytea *value);
+static element_set_t *set_from_array(FunctionCallInfo fcinfo, ArrayType *input);
+static uint32 intersect_sets(element_set_t *eset1, element_set_t *eset2);
+static uint32 intersect_sorted(const char *a, uint32 na, const char *b, uint32 nb,
+							   int16 typlen, bool byval);
+static uint32 intersect_sorted_4(const char *a, uint32 na, const char *b, uint32 nb);
+static uint32 intersect_sorted_8(const char *a, uint32 na, const char *b, uint32 nb);
+static uint32 intersect_gallop(const char *a, uint32 na, const char *b, uint32 nb,
+							   int16 typlen, bool byval);
+static uint32 intersect_varlena(element_set_t *eset1, element_set_t *eset2);
+
+static void copy_value(element_set_t *eset, char *dest, Datum value);
+static char get_key_kind(Oid element_type, int16 typlen, bool typbyval);
+static bool key_order_is_native(Oid element_type, char keykind);
+static void sort_datums(Datum *datums, int ndatums, Oid element_type, Oid collation);
+static int compare_datums(const void *a, const void *b, void *arg);
+static void add_varlena(element_set_t *eset, Datum value);
+static void add_varlena_bytes(element_set_t *eset, const char *ptr, Size len);
+static void reserve_arena(element_set_t *eset, Size len);
+static Size append_arena(element_set_t *dst, element_set_t *src);
+
+static int compare_counted_items(const void *a, const void *b, void *arg);
+static Datum item_datum(element_set_t *eset, char *ptr);
 static void compact_set(element_set_t *eset, bool need_space);
-static Datum build_array(element_set_t *eset, Oid input_type);
+static void sort_items(element_set_t *eset, char *base, uint32 nitems);
+static Datum build_array(element_set_t *eset, Oid input_type, Oid collation);
+static Datum build_array_direct(element_set_t *eset, Oid element_type);
 
 
+void
+_PG_init(void)
+{
+	DefineCustomIntVariable("count_distinct.max_memory",
+							"Maximum amount of memory used by count_distinct states in a backend.",
+							"Queries exceeding the limit fail with an error. -1 means no limit.",
+							&count_distinct_max_memory,
+							-1, -1, MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("count_distinct.track_stats",
+							 "Collects statistics about the work done by count_distinct.",
+							 "The statistics are per-backend, see count_distinct_stats().",
+							 &count_distinct_track_stats,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("count_distinct.partition_bits",
+							"Number of bits of the keys used to partition large batches of new items before sorting.",
+							"The items are sorted in 2^k partitions, 0 means the items are sorted at once.",
+							&count_distinct_partition_bits,
+							0, 0, PARTITION_MAX_BITS,
+							PGC_USERSET,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("count_distinct.max_threads",
+							"Maximum number of threads used to sort and merge large batches of items.",
+							"The threads only run the sort and merge kernels, 1 means no additional threads.",
+							&count_distinct_max_threads,
+							1, 1, MAX_KERNEL_THREADS,
+							PGC_USERSET,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomRealVariable("count_distinct.free_space",
+							 "Fraction of the data array required to be free after compaction.",
+							 "The array grows when the compaction does not free enough space.",
+							 &count_distinct_free_space,
+							 ARRAY_FREE_FRACT, 0.01, 0.9,
+							 PGC_USERSET,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomRealVariable("count_distinct.fast_growth_ratio",
+							 "Fraction of duplicates removed by compactions below which the data array doubles.",
+							 NULL,
+							 &count_distinct_fast_growth_ratio,
+							 0.1, 0.0, 1.0,
+							 PGC_USERSET,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomRealVariable("count_distinct.slow_growth_ratio",
+							 "Fraction of duplicates removed by compactions above which the data array grows only to get the free space.",
+							 NULL,
+							 &count_distinct_slow_growth_ratio,
+							 0.5, 0.0, 1.0,
+							 PGC_USERSET,
+							 0,
+							 NULL, NULL, NULL);
+}
+
 Datum
 count_distinct_append(PG_FUNCTION_ARGS)
 {
 	element_set_t  *eset;
 
 	/* info for anyelement */
-	Oid			element_type = get_fn_expr_argtype(fcinfo->flinfo, 1);
 	Datum		element = PG_GETARG_DATUM(1);
 
 	/* memory contexts */
@@ -177,24 +531,12 @@ count_distinct_append(PG_FUNCTION_ARGS)
 
 	/* init the hash table, if needed */
 	if (PG_ARGISNULL(0))
-	{
-		int16		typlen;
-		bool		typbyval;
-		char		typalign;
-
-		/* get type information for the second parameter (anyelement item) */
-		get_typlenbyvalalign(element_type, &typlen, &typbyval, &typalign);
-
-		/* we can't handle varlena types yet or values passed by reference */
-		if ((typlen < 0) || (! typbyval))
-			elog(ERROR, "count_distinct handles only fixed-length types passed by value");
-
-		eset = init_set(typlen, typbyval, typalign, aggcontext);
-	} else
+		eset = init_set(get_element_info(fcinfo, false), aggcontext, false);
+	else
 		eset = (element_set_t *) PG_GETARG_POINTER(0);
 
 	/* add the value into the set */
-	add_element(eset, (char *) &element);
+	add_element(eset, element);
 
 	MemoryContextSwitchTo(oldcontext);
 
@@ -204,24 +546,12 @@ count_distinct_append(PG_FUNCTION_ARGS)
 Datum
 count_distinct_elements_append(PG_FUNCTION_ARGS)
 {
-	int				i;
 	element_set_t  *eset = NULL;
 
-	/* info for anyarray */
-	Oid	input_type;
-	Oid	element_type;
-
 	/* array data */
 	ArrayType  *input;
-	Datum	   *elements;
-	bool	   *nulls;
 	int			nelements;
 
-	/* needed for array deconstruction */
-	int16		typlen;
-	bool		typbyval;
-	char		typalign;
-
 	/* memory contexts */
 	MemoryContext	oldcontext;
 	MemoryContext	aggcontext;
@@ -243,76 +573,81 @@ count_distinct_elements_append(PG_FUNCTION_ARGS)
 
 	/* from now on we know the new value is not NULL */
 
-	/* get the type of array elements */
-	input_type = get_fn_expr_argtype(fcinfo->flinfo, 1);
-	element_type = get_element_type(input_type);
-
 	/* make sure we're running as part of aggregate function */
 	GET_AGG_CONTEXT("count_distinct_elements_append", fcinfo, aggcontext);
 
+	/*
+	 * parse the array contents (we know we got non-NULL value) - we do this
+	 * before switching to the aggregate context, so that the detoasted copy
+	 * does not stay there until the end of the aggregation
+	 */
+	input = PG_GETARG_ARRAYTYPE_P(1);
+	nelements = ArrayGetNItems(ARR_NDIM(input), ARR_DIMS(input));
+
 	oldcontext = MemoryContextSwitchTo(aggcontext);
 
 	/* get existing state, if any (otherwise leave it NULL) */
 	if (!PG_ARGISNULL(0))
 		eset = (element_set_t *) PG_GETARG_POINTER(0);
 
-	/* parse the array contents (we know we got non-NULL value) */
-	input = PG_GETARG_ARRAYTYPE_P(1);
+	/* init the hash table, if needed (but only with a non-NULL element) */
+	if (!eset && array_has_values(input, nelements))
+		eset = init_set(get_element_info(fcinfo, true), aggcontext, false);
 
-	/*
-	 * get type information for the second parameter (anyelement item), from
-	 * the existing state or from cache.
-	 */
+	/* add all non-NULL array elements to the set */
 	if (eset)
-	{
-		typlen = eset->typlen;
-		typbyval = eset->typbyval;
-		typalign = eset->typalign;
-	}
-	else
-		get_typlenbyvalalign(element_type, &typlen, &typbyval, &typalign);
+		add_elements(eset, input, nelements);
 
-	/* we can't handle varlena types yet or values passed by reference */
-	if ((typlen < 0) || (! typbyval))
-		elog(ERROR, "count_distinct handles only fixed-length types passed by value");
+	MemoryContextSwitchTo(oldcontext);
 
-	deconstruct_array(input,
-					  element_type, typlen, typbyval, typalign,
-					  &elements, &nulls, &nelements);
+	if (eset == NULL)
+		PG_RETURN_NULL();
 
-	/* add all non-NULL array elements to the set */
-	for (i = 0; i < nelements; i++)
-	{
-		Datum	value;
+	PG_RETURN_POINTER(eset);
+}
 
-		/* ignore nulls */
-		if (nulls[i])
-			continue;
+/*
+ * Transition function of the multi-column variants - the values are packed
+ * into a composite key (see composite_info_t), so that the rest works just
+ * like for a single column of a fixed-length type. Rows with NULL in any of
+ * the columns are ignored.
+ */
+Datum
+count_distinct_multi_append(PG_FUNCTION_ARGS)
+{
+	element_set_t	   *eset;
+	composite_info_t   *cinfo;
+	int					i;
 
-		/* init the hash table, if needed */
-		if (!eset)
-			eset = init_set(typlen, typbyval, typalign, aggcontext);
+	/* memory contexts */
+	MemoryContext	oldcontext;
+	MemoryContext	aggcontext;
 
-		/*
-		 * We need to copy just the significant bytes - we can't use memcpy
-		 * directly, as that assumes little endian behavior.  store_att_byval
-		 * does almost what we need, but it requires properly aligned buffer.
-		 * We simply use a local Datum variable (which does guarante proper
-		 * alignment), and then copy the value from it.
-		 */
-		store_att_byval(&value, elements[i], eset->typlen);
+	for (i = 1; i < PG_NARGS(); i++)
+	{
+		if (PG_ARGISNULL(i))
+		{
+			if (PG_ARGISNULL(0))
+				PG_RETURN_NULL();
 
-		add_element(eset, (char *) &value);
+			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+		}
 	}
 
-	MemoryContextSwitchTo(oldcontext);
+	GET_AGG_CONTEXT("count_distinct_multi_append", fcinfo, aggcontext);
 
-	/* free arrays allocated by deconstruct_array */
-	pfree(elements);
-	pfree(nulls);
+	cinfo = get_composite_info(fcinfo);
 
-	if (eset == NULL)
-		PG_RETURN_NULL();
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+
+	if (PG_ARGISNULL(0))
+		eset = init_set(&cinfo->info, aggcontext, false);
+	else
+		eset = (element_set_t *) PG_GETARG_POINTER(0);
+
+	add_element(eset, pack_composite(cinfo, fcinfo));
+
+	MemoryContextSwitchTo(oldcontext);
 
 	PG_RETURN_POINTER(eset);
 }
@@ -321,65 +656,40 @@ Datum
 count_distinct_serial(PG_FUNCTION_ARGS)
 {
 	element_set_t *eset = (element_set_t *) PG_GETARG_POINTER(0);
-	Size	hlen = offsetof(element_set_t, data);	/* header */
-	Size	dlen;									/* elements */
-	bytea  *out;									/* output */
-	char   *ptr;
+	bytea		  *result;
 
 	Assert(eset != NULL);
 
 	CHECK_AGG_CONTEXT("count_distinct_serial", fcinfo);
 
-	/*
-	 * force compaction, so that we serialize the smallest amount of data
-	 * and also make sure the data is sorted (and the sort happens in the
-	 * parallel workers, ot distribute the CPU better)
-	 */
-	compact_set(eset, false);
-
-	Assert(eset->nall > 0);
-	Assert(eset->nall == eset->nsorted);
-
-	dlen = eset->nall * eset->typlen;
-
-	out = (bytea *) palloc(VARHDRSZ + dlen + hlen);
+	TRACE_COUNT_DISTINCT_SERIAL_START(eset->nall, eset->typlen);
 
-	SET_VARSIZE(out, VARHDRSZ + dlen + hlen);
-	ptr = VARDATA(out);
+	result = serialize_set(eset);
 
-	memcpy(ptr, eset, hlen);
-	ptr += hlen;
+	TRACE_COUNT_DISTINCT_SERIAL_DONE(VARSIZE(result));
 
-	memcpy(ptr, eset->data, dlen);
+	STATS_ADD(serial_calls, 1);
+	STATS_ADD(serial_bytes, VARSIZE(result));
 
-	PG_RETURN_BYTEA_P(out);
+	PG_RETURN_BYTEA_P(result);
 }
 
 Datum
 count_distinct_deserial(PG_FUNCTION_ARGS)
 {
-	element_set_t *eset = (element_set_t *) palloc(sizeof(element_set_t));
-	bytea  *state = (bytea *) PG_GETARG_POINTER(0);
-	Size	len PG_USED_FOR_ASSERTS_ONLY = VARSIZE_ANY_EXHDR(state);
-	char   *ptr = VARDATA_ANY(state);
+	bytea		  *state = (bytea *) PG_GETARG_POINTER(0);
+	element_set_t *eset;
 
 	CHECK_AGG_CONTEXT("count_distinct_deserial", fcinfo);
 
-	Assert(len > 0);
-	Assert((len - offsetof(element_set_t, data)) > 0);
-
-	/* copy the header */
-	memcpy(eset, ptr, offsetof(element_set_t, data));
-	ptr += offsetof(element_set_t, data);
+	STATS_ADD(deserial_calls, 1);
+	STATS_ADD(deserial_bytes, VARSIZE(state));
 
-	Assert((eset->nall > 0) && (eset->nall == eset->nsorted));
-	Assert(len == offsetof(element_set_t, data) + eset->nall * eset->typlen);
+	TRACE_COUNT_DISTINCT_DESERIAL_START(VARSIZE(state));
 
-	/* we only allocate the necessary space */
-	eset->data = palloc(eset->nall * eset->typlen);
-	eset->nbytes = eset->nall * eset->typlen;
+	eset = deserialize_set(state);
 
-	memcpy((void *) eset->data, ptr, eset->nall * eset->typlen);
+	TRACE_COUNT_DISTINCT_DESERIAL_DONE(eset->nall, eset->typlen);
 
 	PG_RETURN_POINTER(eset);
 }
@@ -387,12 +697,6 @@ count_distinct_deserial(PG_FUNCTION_ARGS)
 Datum
 count_distinct_combine(PG_FUNCTION_ARGS)
 {
-	int				i;
-	char		   *data,
-				   *tmp,
-				   *ptr1,
-				   *ptr2,
-				   *prev;
 	element_set_t  *eset1;
 	element_set_t  *eset2;
 	MemoryContext	agg_context;
@@ -403,6 +707,8 @@ count_distinct_combine(PG_FUNCTION_ARGS)
 	eset1 = PG_ARGISNULL(0) ? NULL : (element_set_t *) PG_GETARG_POINTER(0);
 	eset2 = PG_ARGISNULL(1) ? NULL : (element_set_t *) PG_GETARG_POINTER(1);
 
+	STATS_ADD(combine_calls, 1);
+
 	if (eset2 == NULL) {
 		/* pass eset1 down the line */
 		if (eset1 == NULL)
@@ -411,6 +717,11 @@ count_distinct_combine(PG_FUNCTION_ARGS)
 			PG_RETURN_POINTER(eset1);
 	}
 
+	STATS_ADD(combine_bytes, (Size) eset2->nall * eset2->itemlen + eset2->arena_used);
+
+	TRACE_COUNT_DISTINCT_COMBINE_START((eset1 != NULL) ? eset1->nall : 0,
+									   eset2->nall, eset2->typlen);
+
 	if (eset1 == NULL)
 	{
 		old_context = MemoryContextSwitchTo(agg_context);
@@ -419,96 +730,16 @@ count_distinct_combine(PG_FUNCTION_ARGS)
 
 		MemoryContextSwitchTo(old_context);
 
+		TRACE_COUNT_DISTINCT_COMBINE_DONE(eset1->nall);
+
 		PG_RETURN_POINTER(eset1);
 	}
 
 	Assert((eset1 != NULL) && (eset2 != NULL));
-	Assert((eset1->typlen > 0) && (eset1->typlen == eset2->typlen));
-
-	/* make sure both states are sorted */
-	compact_set(eset1, false);
-	compact_set(eset2, false);
-
-	data = MemoryContextAlloc(agg_context, (eset1->nbytes + eset2->nbytes));
-	tmp = data;
-
-	/* merge the two arrays */
-	ptr1 = eset1->data;
-	ptr2 = eset2->data;
-	prev = NULL;
-
-	for (i = 0; i < eset1->nall + eset2->nall; i++)
-	{
-		char *element;
-
-		Assert(ptr1 <= (eset1->data + eset1->nbytes));
-		Assert(ptr2 <= (eset2->data + eset2->nbytes));
-
-		if ((ptr1 < (eset1->data + eset1->nbytes)) &&
-			(ptr2 < (eset2->data + eset2->nbytes)))
-		{
-			if (memcmp(ptr1, ptr2, eset1->typlen) <= 0)
-			{
-				element = ptr1;
-				ptr1 += eset1->typlen;
-			}
-			else
-			{
-				element = ptr2;
-				ptr2 += eset1->typlen;
-			}
-		}
-		else if (ptr1 < (eset1->data + eset1->nbytes))
-		{
-			element = ptr1;
-			ptr1 += eset1->typlen;
-		}
-		else if (ptr2 < (eset2->data + eset2->nbytes))
-		{
-			element = ptr2;
-			ptr2 += eset2->typlen;
-		}
-		else
-			elog(ERROR, "unexpected");
-
-		/*
-		 * Now figure out what to do with the element - we need to compare it
-		 * to the last value, and only keep it if it's different (and it better
-		 * be greater than the last value).
-		 */
-		if (tmp == data)
-		{
-			/* first value, so just copy */
-			memcpy(tmp, element, eset1->typlen);
-			prev = tmp;
-			tmp += eset1->typlen;
-		}
-		else if (memcmp(prev, element, eset1->typlen) != 0)
-		{
-			/* not equal to the last one, so should be greater */
-			Assert(memcmp(prev, element, eset1->typlen) < 0);
-
-			/* first value, so just copy */
-			memcpy(tmp, element, eset1->typlen);
-			prev = tmp;
-			tmp += eset1->typlen;
-		}
-	}
 
-	/* we must have processed the input arrays completely */
-	Assert(ptr1 == (eset1->data + (eset1->nall * eset1->typlen)));
-	Assert(ptr2 == (eset2->data + (eset2->nall * eset2->typlen)));
+	merge_sets(eset1, eset2);
 
-	/* we might have eliminated some duplicate elements */
-	Assert((tmp - data) <= ((eset1->nall + eset2->nall) * eset1->typlen));
-
-	pfree(eset1->data);
-	eset1->data = data;
-
-	/* and finally compute the current number of elements */
-	eset1->nbytes = tmp - data;
-	eset1->nall = eset1->nbytes / eset1->typlen;
-	eset1->nsorted = eset1->nall;
+	TRACE_COUNT_DISTINCT_COMBINE_DONE(eset1->nall);
 
 	PG_RETURN_POINTER(eset1);
 }
@@ -525,7 +756,13 @@ count_distinct(PG_FUNCTION_ARGS)
 
 	eset = (element_set_t *) PG_GETARG_POINTER(0);
 
-	/* do the compaction */
+	/*
+	 * Do the compaction. This only sorts the items and removes duplicates
+	 * (the contents of the set remain the same), so it's fine to do that
+	 * repeatedly and continue adding values (e.g. in window aggregates), and
+	 * the state may be shared with other aggregates on the same input (so
+	 * the final functions are declared as FINALFUNC_MODIFY = READ_ONLY).
+	 */
 	compact_set(eset, false);
 
 	PG_RETURN_INT64(eset->nall);
@@ -547,7 +784,7 @@ array_agg_distinct_type_by_element(PG_FUNCTION_ARGS)
 	if (PG_ARGISNULL(0))
 		PG_RETURN_DATUM(PointerGetDatum(construct_empty_array(element_type)));
 
-	PG_RETURN_DATUM(build_array(eset, element_type));
+	PG_RETURN_DATUM(build_array(eset, element_type, PG_GET_COLLATION()));
 }
 
 Datum
@@ -568,303 +805,2811 @@ array_agg_distinct_type_by_array(PG_FUNCTION_ARGS)
 	if (PG_ARGISNULL(0))
 		PG_RETURN_DATUM(PointerGetDatum(construct_empty_array(element_type)));
 
-	PG_RETURN_DATUM(build_array(eset, element_type));
+	PG_RETURN_DATUM(build_array(eset, element_type, PG_GET_COLLATION()));
 }
 
-static Datum
-build_array(element_set_t *eset, Oid element_type)
+Datum
+distinct_set_final(PG_FUNCTION_ARGS)
 {
-	Datum		*array_of_datums;
-	ArrayType   *array;
-	int i;
-
-	/* do the compaction */
-	compact_set(eset, false);
-
-	/*
-	 * Copy data from compact array to array of Datums
-	 * A bit suboptimal way, spends excessive memory.
-	 */
-	array_of_datums = palloc0(eset->nsorted * sizeof(Datum));
-	for (i = 0; i < eset->nsorted; i++)
-		memcpy(array_of_datums + i, eset->data + (eset->typlen * i), eset->typlen);
+	CHECK_AGG_CONTEXT("distinct_set_final", fcinfo);
 
-	/* build and return the array */
-	array = construct_array(array_of_datums, eset->nsorted, element_type,
-							eset->typlen, eset->typbyval, eset->typalign);
-
-	/* free the array (not needed anymore) */
-	pfree(array_of_datums);
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-	return PointerGetDatum(array);
+	/* the serialization only compacts the set, so it's fine for READ_ONLY */
+	PG_RETURN_BYTEA_P(serialize_set((element_set_t *) PG_GETARG_POINTER(0)));
 }
 
 /*
- * performs compaction of the sorted set
- *
- * Sorts the unsorted data, removes duplicate values and then merges it
- * into the already sorted part (skipping duplicate values).
- *
- * Finally, it checks whether at least ARRAY_FREE_FRACT (20%) of the array
- * is empty, and if not then resizes it.
+ * distinct_set values use the same format as the serialized aggregate state
+ * (see serialize_set), so that they can be merged efficiently. The external
+ * representation (text and binary) has integers in network byte order, but
+ * is only portable between platforms for types passed by value (see
+ * write_set). The text format is simply the hex encoding of the binary
+ * format, with the same \x prefix as bytea.
  */
-static void
-compact_set(element_set_t *eset, bool need_space)
+Datum
+distinct_set_in(PG_FUNCTION_ARGS)
 {
-	char   *base = eset->data + (eset->nsorted * eset->typlen);
-	char   *last = base;
-	char   *curr;
-	int		i;
-	int		cnt = 1;
-	double	free_fract;
+	char   *str = PG_GETARG_CSTRING(0);
+	Size	len = strlen(str);
+	Size	i;
+	StringInfoData	buf;
 
-	Assert(eset->nall > 0);
-	Assert(eset->data != NULL);
-	Assert(eset->nsorted <= eset->nall);
-	Assert(eset->nall * eset->typlen <= eset->nbytes);
+	if ((len < 2) || (str[0] != '\\') || (str[1] != 'x') || (len % 2 != 0))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+				 errmsg("invalid input syntax for type %s: \"%s\"",
+						"distinct_set", str)));
 
-	/* if there are no new (unsorted) items, we don't need to sort */
-	if (eset->nall > eset->nsorted)
+	initStringInfo(&buf);
+
+	for (i = 2; i < len; i += 2)
 	{
-		/*
-		 * sort the array with new items, but only when not already sorted
-		 *
-		 * TODO Consider replacing this insert-sort for small number of items
-		 * (for <64 items it might be faster than qsort)
-		 */
-		qsort_arg(eset->data + eset->nsorted * eset->typlen,
-				  eset->nall - eset->nsorted, eset->typlen,
-				  compare_items, &eset->typlen);
+		int		hi = hex_value(str[i]);
+		int		lo = hex_value(str[i + 1]);
 
-		/*
-		 * Remove duplicate values from the sorted array. That is - walk through
-		 * the array, compare each item with the preceding one, and only keep it
-		 * if they differ. We skip the first value, as it's always unique (there
-		 * is no preceding value it might be equal to).
-		 */
-		for (i = 1; i < eset->nall - eset->nsorted; i++)
-		{
-			curr = base + (i * eset->typlen);
+		if ((hi < 0) || (lo < 0))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+					 errmsg("invalid input syntax for type %s: \"%s\"",
+							"distinct_set", str)));
 
-			/* items differ (keep the item) */
-			if (memcmp(last, curr, eset->typlen) != 0)
-			{
-				last += eset->typlen;
-				cnt  += 1;
+		appendStringInfoChar(&buf, (char) ((hi << 4) | lo));
+	}
 
-				/* only copy if really needed */
-				if (last != curr)
-					memcpy(last, curr, eset->typlen);
-			}
-		}
+	PG_RETURN_BYTEA_P(read_set(&buf));
+}
 
-		/* duplicities removed -> update the number of items in this part */
-		eset->nall = eset->nsorted + cnt;
+Datum
+distinct_set_out(PG_FUNCTION_ARGS)
+{
+	static const char hextbl[] = "0123456789abcdef";
+
+	bytea  *value = PG_GETARG_BYTEA_P(0);
+	char   *result;
+	char   *ptr;
+	int		i;
+	StringInfoData	buf;
+
+	initStringInfo(&buf);
+	write_set(&buf, value);
+
+	result = palloc(2 * buf.len + 3);
+	ptr = result;
+
+	*ptr++ = '\\';
+	*ptr++ = 'x';
+
+	for (i = 0; i < buf.len; i++)
+	{
+		*ptr++ = hextbl[(buf.data[i] >> 4) & 0xF];
+		*ptr++ = hextbl[buf.data[i] & 0xF];
+	}
+
+	*ptr = '\0';
+
+	PG_RETURN_CSTRING(result);
+}
+
+Datum
+distinct_set_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo	buf = (StringInfo) PG_GETARG_POINTER(0);
+
+	PG_RETURN_BYTEA_P(read_set(buf));
+}
+
+Datum
+distinct_set_send(PG_FUNCTION_ARGS)
+{
+	bytea  *value = PG_GETARG_BYTEA_P(0);
+	StringInfoData	buf;
+
+	pq_begintypsend(&buf);
+	write_set(&buf, value);
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+Datum
+distinct_set_cardinality(PG_FUNCTION_ARGS)
+{
+	/* we only need the header, so don't detoast the whole value */
+	bytea  *value = PG_GETARG_BYTEA_P_SLICE(0, 0, sizeof(serial_header_t));
+	serial_header_t	hdr;
+
+	if (VARSIZE_ANY_EXHDR(value) < sizeof(serial_header_t))
+		elog(ERROR, "invalid distinct_set value");
+
+	memcpy(&hdr, VARDATA_ANY(value), sizeof(serial_header_t));
+
+	if (hdr.version != SERIAL_FORMAT_VERSION)
+		elog(ERROR, "unsupported distinct set format version %d", hdr.version);
+
+	PG_RETURN_INT64(hdr.nall);
+}
+
+/*
+ * transition function of the union aggregate - the sets are added to the
+ * state just like new values (into the unsorted part), so that merging a
+ * lot of small sets does not have to copy the whole state every time
+ */
+Datum
+distinct_set_union_append(PG_FUNCTION_ARGS)
+{
+	element_set_t  *eset = NULL;
+	element_set_t  *other = NULL;
+	bytea		   *value;
+
+	/* memory contexts */
+	MemoryContext	oldcontext;
+	MemoryContext	aggcontext;
+
+	if (PG_ARGISNULL(1) && PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+	else if (PG_ARGISNULL(1))
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+
+	GET_AGG_CONTEXT("distinct_set_union_append", fcinfo, aggcontext);
+
+	/* detoast (and deserialize) the new set outside the aggregate context */
+	value = PG_GETARG_BYTEA_P(1);
+
+	if (!PG_ARGISNULL(0))
+	{
+		eset = (element_set_t *) PG_GETARG_POINTER(0);
+		other = deserialize_set(value);
+	}
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+
+	if (eset == NULL)
+		eset = deserialize_set(value);
+	else
+		append_set(eset, other);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_POINTER(eset);
+}
+
+/*
+ * Intersection of two sets (number of values in both sets), and Jaccard
+ * similarity (size of the intersection divided by the size of the union).
+ *
+ * The sets are sorted and without duplicates, so the intersection is a
+ * simple merge (or a galloping search when one set is much smaller). The
+ * distinct_set values are used directly, without deserializing them, the
+ * arrays are turned into sets first (their ordering may not match ours).
+ */
+Datum
+distinct_set_intersect(PG_FUNCTION_ARGS)
+{
+	element_set_t	eset1;
+	element_set_t	eset2;
+
+	set_from_value(&eset1, PG_GETARG_BYTEA_P(0));
+	set_from_value(&eset2, PG_GETARG_BYTEA_P(1));
+
+	PG_RETURN_INT64(intersect_sets(&eset1, &eset2));
+}
+
+Datum
+distinct_set_jaccard(PG_FUNCTION_ARGS)
+{
+	element_set_t	eset1;
+	element_set_t	eset2;
+	uint32			ninter;
+
+	set_from_value(&eset1, PG_GETARG_BYTEA_P(0));
+	set_from_value(&eset2, PG_GETARG_BYTEA_P(1));
+
+	ninter = intersect_sets(&eset1, &eset2);
+
+	/* similarity of two empty sets is not defined (same as for arrays) */
+	if (eset1.nall + eset2.nall == 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8((double) ninter /
+					 ((double) eset1.nall + eset2.nall - ninter));
+}
+
+Datum
+array_intersect_distinct(PG_FUNCTION_ARGS)
+{
+	element_set_t  *eset1 = set_from_array(fcinfo, PG_GETARG_ARRAYTYPE_P(0));
+	element_set_t  *eset2 = set_from_array(fcinfo, PG_GETARG_ARRAYTYPE_P(1));
+
+	PG_RETURN_INT64(intersect_sets(eset1, eset2));
+}
+
+Datum
+array_jaccard_distinct(PG_FUNCTION_ARGS)
+{
+	element_set_t  *eset1 = set_from_array(fcinfo, PG_GETARG_ARRAYTYPE_P(0));
+	element_set_t  *eset2 = set_from_array(fcinfo, PG_GETARG_ARRAYTYPE_P(1));
+	uint32			ninter = intersect_sets(eset1, eset2);
+
+	/* similarity of two empty sets is not defined */
+	if (eset1->nall + eset2->nall == 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8((double) ninter /
+					 ((double) eset1->nall + eset2->nall - ninter));
+}
+
+/*
+ * Transition function for counted sets (multisets), tracking the number of
+ * occurrences for each distinct value. The second argument is stored in the
+ * state, for the final function (minimum number of occurrences, or number
+ * of the most frequent values), so it has to be the same for all rows.
+ */
+Datum
+count_distinct_counted_append(PG_FUNCTION_ARGS)
+{
+	element_set_t  *eset;
+	int32			argument;
+
+	/* memory contexts */
+	MemoryContext	oldcontext;
+	MemoryContext	aggcontext;
+
+	if (PG_ARGISNULL(1) && PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+	else if (PG_ARGISNULL(1))
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+
+	if (PG_ARGISNULL(2) || (PG_GETARG_INT32(2) < 0))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("the argument must be a non-negative integer")));
+
+	argument = PG_GETARG_INT32(2);
+
+	GET_AGG_CONTEXT("count_distinct_counted_append", fcinfo, aggcontext);
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+
+	if (PG_ARGISNULL(0))
+	{
+		eset = init_set(get_element_info(fcinfo, false), aggcontext, true);
+		eset->argument = argument;
+	}
+	else
+	{
+		eset = (element_set_t *) PG_GETARG_POINTER(0);
+
+		if (eset->argument != argument)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("the argument has to be the same for all rows in a group")));
+	}
+
+	add_element(eset, PG_GETARG_DATUM(1));
+
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_POINTER(eset);
+}
+
+/* number of distinct values with at least k occurrences */
+Datum
+count_distinct_min_occurrences(PG_FUNCTION_ARGS)
+{
+	element_set_t  *eset;
+	int64			count = 0;
+	uint32			i;
+
+	CHECK_AGG_CONTEXT("count_distinct_min_occurrences", fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	eset = (element_set_t *) PG_GETARG_POINTER(0);
+
+	Assert(SET_IS_COUNTED(eset));
+
+	/* the compaction adds counts of duplicate items together */
+	compact_set(eset, false);
+
+	for (i = 0; i < eset->nall; i++)
+	{
+		if (get_item_count(eset, eset->data + (Size) i * eset->itemlen) >= (uint64) eset->argument)
+			count++;
+	}
+
+	PG_RETURN_INT64(count);
+}
+
+/*
+ * array of the n most frequent values (in descending order of frequency,
+ * values with the same frequency are in the order of keys)
+ */
+Datum
+top_values(PG_FUNCTION_ARGS)
+{
+	element_set_t  *eset;
+	Oid				element_type;
+	char		  **items;
+	Datum		   *values;
+	uint32			nvalues;
+	uint32			i;
+	int16			typlen;
+	bool			typbyval;
+	char			typalign;
+
+	CHECK_AGG_CONTEXT("top_values", fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	eset = (element_set_t *) PG_GETARG_POINTER(0);
+	element_type = get_fn_expr_argtype(fcinfo->flinfo, 1);
+
+	Assert(SET_IS_COUNTED(eset));
+
+	compact_set(eset, false);
+
+	/* sort pointers to the items by count (we need the items unchanged) */
+	items = MemoryContextAllocHuge(CurrentMemoryContext,
+								   (Size) eset->nall * sizeof(char *));
+
+	for (i = 0; i < eset->nall; i++)
+		items[i] = eset->data + (Size) i * eset->itemlen;
+
+	qsort_arg(items, eset->nall, sizeof(char *), compare_counted_items, eset);
+
+	nvalues = Min(eset->nall, (uint32) eset->argument);
+	values = palloc(Max(nvalues, 1) * sizeof(Datum));
+
+	for (i = 0; i < nvalues; i++)
+		values[i] = item_datum(eset, items[i]);
+
+	get_typlenbyvalalign(element_type, &typlen, &typbyval, &typalign);
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(values, nvalues, element_type,
+										  typlen, typbyval, typalign));
+}
+
+/*
+ * statistics collected in this backend (with count_distinct.track_stats),
+ * returned as a single row
+ */
+Datum
+count_distinct_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[12];
+	bool		nulls[12];
+	int			i = 0;
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	Assert(tupdesc->natts == lengthof(values));
+
+	memset(nulls, 0, sizeof(nulls));
+
+	values[i++] = Int64GetDatum(stats.compactions);
+	values[i++] = Int64GetDatum(stats.merges);
+	values[i++] = Float8GetDatum(stats.sort_time / 1000.0);
+	values[i++] = Int64GetDatum(stats.bytes_copied);
+	values[i++] = Int64GetDatum(stats.reallocations);
+	values[i++] = Int64GetDatum(stats.peak_state_size);
+	values[i++] = Int64GetDatum(stats.combine_calls);
+	values[i++] = Int64GetDatum(stats.combine_bytes);
+	values[i++] = Int64GetDatum(stats.serial_calls);
+	values[i++] = Int64GetDatum(stats.serial_bytes);
+	values[i++] = Int64GetDatum(stats.deserial_calls);
+	values[i++] = Int64GetDatum(stats.deserial_bytes);
+
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * Transition function of count_distinct_state_info - adds the values into
+ * a set exactly like count_distinct_append, but also counts them.
+ */
+Datum
+count_distinct_state_info_append(PG_FUNCTION_ARGS)
+{
+	state_info_t   *state;
+
+	/* memory contexts */
+	MemoryContext	oldcontext;
+	MemoryContext	aggcontext;
+
+	if (PG_ARGISNULL(1) && PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+	else if (PG_ARGISNULL(1))
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+
+	GET_AGG_CONTEXT("count_distinct_state_info_append", fcinfo, aggcontext);
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+
+	if (PG_ARGISNULL(0))
+	{
+		state = (state_info_t *) palloc(sizeof(state_info_t));
+		state->eset = init_set(get_element_info(fcinfo, false), aggcontext, false);
+		state->nvalues = 0;
+	}
+	else
+		state = (state_info_t *) PG_GETARG_POINTER(0);
+
+	add_element(state->eset, PG_GETARG_DATUM(1));
+	state->nvalues += 1;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * Describe the final state as jsonb - number of distinct and all values,
+ * compactions, memory allocated for the state vs. used by the items (and
+ * live values in the arena), how the values are represented, size of the
+ * serialized state (e.g. when passed from parallel workers), and the ratio
+ * of duplicates removed by compactions (driving the growth of the array).
+ */
+Datum
+count_distinct_state_info(PG_FUNCTION_ARGS)
+{
+	state_info_t   *state;
+	element_set_t  *eset;
+	bytea		   *serialized;
+	StringInfoData	buf;
+	Size			allocated;
+	Size			used;
+
+	CHECK_AGG_CONTEXT("count_distinct_state_info", fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (state_info_t *) PG_GETARG_POINTER(0);
+	eset = state->eset;
+
+	/* same as in count_distinct (does not change the contents) */
+	compact_set(eset, false);
+
+	allocated = MAXALIGN(sizeof(element_set_t)) + eset->nbytes + eset->arena_size;
+	used = MAXALIGN(sizeof(element_set_t)) + (Size) eset->nall * eset->itemlen;
+
+	if (eset->typlen == -1)
+		used += packed_arena_size(eset);
+
+	serialized = serialize_set(eset);
+
+	initStringInfo(&buf);
+
+	appendStringInfo(&buf, "{\"distinct\": %u, \"values\": " INT64_FORMAT
+					 ", \"compactions\": %u, \"allocated\": %zu, \"used\": %zu"
+					 ", \"representation\": \"%s\", \"key\": \"%s\""
+					 ", \"item_size\": %d, \"serialized\": %u"
+					 ", \"dedup_ratio\": %.3f}",
+					 eset->nall, state->nvalues, eset->ncompactions,
+					 allocated, used,
+					 (eset->flags & SET_DATA_INLINE) ? "inline" : "array",
+					 key_kind_name(eset->keykind), eset->itemlen,
+					 VARSIZE(serialized), eset->dedup_ratio);
+
+	pfree(serialized);
+
+	PG_RETURN_DATUM(DirectFunctionCall1(jsonb_in, CStringGetDatum(buf.data)));
+}
+
+/* discard the statistics collected in this backend */
+Datum
+count_distinct_stats_reset(PG_FUNCTION_ARGS)
+{
+	memset(&stats, 0, sizeof(count_distinct_stats_t));
+
+	PG_RETURN_VOID();
+}
+
+static Datum
+build_array(element_set_t *eset, Oid element_type, Oid collation)
+{
+	Datum		*array_of_datums;
+	ArrayType   *array;
+	uint32		i;
+
+	/* do the compaction */
+	compact_set(eset, false);
+
+	/*
+	 * If the keys are already in the right order and the values are stored
+	 * in the same format as in the array, we can build the array directly
+	 * from the data array.
+	 */
+	if ((eset->typlen > 0) &&
+		(att_align_nominal(eset->typlen, eset->typalign) == eset->typlen) &&
+		key_order_is_native(element_type, eset->keykind))
+		return build_array_direct(eset, element_type);
+
+	/*
+	 * Copy data from compact array to array of Datums
+	 * A bit suboptimal way, spends excessive memory.
+	 *
+	 * For large sets the Datum array may exceed MaxAllocSize even if the
+	 * resulting array would not (e.g. for int2 values), so allow huge
+	 * allocations here.
+	 */
+	array_of_datums = MemoryContextAllocHuge(CurrentMemoryContext,
+											 (Size) eset->nsorted * sizeof(Datum));
+	for (i = 0; i < eset->nsorted; i++)
+		array_of_datums[i] = item_datum(eset, eset->data + ((Size) eset->itemlen * i));
+
+	/* sort the values, unless the keys are already in the right order */
+	if (!key_order_is_native(element_type, eset->keykind))
+		sort_datums(array_of_datums, eset->nsorted, element_type, collation);
+
+	/* build and return the array */
+	array = construct_array(array_of_datums, eset->nsorted, element_type,
+							eset->typlen, SET_TYPBYVAL(eset), eset->typalign);
+
+	/* free the array (not needed anymore) */
+	pfree(array_of_datums);
+
+	return PointerGetDatum(array);
+}
+
+/*
+ * Datum for the value of an item. Values passed by reference are stored
+ * inline at their natural length, so the Datums simply point into the data
+ * array (or the arena). Values passed by value are decoded from the keys.
+ */
+static Datum
+item_datum(element_set_t *eset, char *ptr)
+{
+	if (eset->typlen == -1)
+	{
+		varlena_item_t *item = (varlena_item_t *) ptr;
+
+		return PointerGetDatum(eset->arena + item->offset);
+	}
+	else if (SET_TYPBYVAL(eset))
+	{
+		Datum	key;
+
+		memcpy(&key, ptr, eset->typlen);
+		decode_key(eset->keykind, (char *) &key, eset->typlen);
+
+		return fetch_att(&key, true, eset->typlen);
+	}
+
+	return PointerGetDatum(ptr);
+}
+
+/*
+ * Build one-dimensional array directly from the (sorted) data array.
+ *
+ * The keys are stored at typlen, without any padding, which is exactly the
+ * layout of the array data area (the caller checks the alignment does not
+ * require any padding). So we simply lay out the array header and copy the
+ * whole data array using a single memcpy, and then decode the keys in place
+ * (for values passed by value).
+ */
+static Datum
+build_array_direct(element_set_t *eset, Oid element_type)
+{
+	ArrayType  *array;
+	Size		dlen = (Size) eset->nsorted * eset->typlen;
+	Size		nbytes = ARR_OVERHEAD_NONULLS(1) + dlen;
+	char	   *ptr;
+
+	/* same limits as construct_md_array */
+	if ((eset->nsorted > MaxArraySize) || !AllocSizeIsValid(nbytes))
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("array size exceeds the maximum allowed (%d)",
+						(int) MaxAllocSize)));
+
+	array = (ArrayType *) palloc0(nbytes);
+
+	SET_VARSIZE(array, nbytes);
+	array->ndim = 1;
+	array->dataoffset = 0;		/* marker for no null bitmap */
+	array->elemtype = element_type;
+
+	ARR_DIMS(array)[0] = eset->nsorted;
+	ARR_LBOUND(array)[0] = 1;
+
+	ptr = ARR_DATA_PTR(array);
+
+	memcpy(ptr, eset->data, dlen);
+
+	/* decode the keys (in place) */
+	if (SET_TYPBYVAL(eset) &&
+		((eset->keykind == KEY_SIGNED) || (eset->keykind == KEY_FLOAT)))
+	{
+		char   *end = ptr + dlen;
+
+		for (; ptr < end; ptr += eset->typlen)
+			decode_key(eset->keykind, ptr, eset->typlen);
+	}
+
+	return PointerGetDatum(array);
+}
+
+/*
+ * performs compaction of the sorted set
+ *
+ * Sorts the unsorted data, removes duplicate values and then merges it
+ * into the already sorted part (skipping duplicate values).
+ *
+ * Finally, it checks whether at least count_distinct.free_space (20% by
+ * default) of the array is empty, and if not then resizes it.
+ */
+static void
+compact_set(element_set_t *eset, bool need_space)
+{
+	char   *base = eset->data + ((Size) eset->nsorted * eset->itemlen);
+	uint32	cnt;
+	double	free_fract;
+	instr_time	start_time;
+	instr_time	sort_time;
+
+	Assert(eset->nall > 0);
+	Assert(eset->data != NULL);
+	Assert(eset->nsorted <= eset->nall);
+	Assert((Size) eset->nall * eset->itemlen <= eset->nbytes);
+
+	TRACE_COUNT_DISTINCT_COMPACT_START(eset->nall, eset->nsorted,
+									   eset->nbytes, eset->typlen);
+
+	/* if there are no new (unsorted) items, we don't need to sort */
+	if (eset->nall > eset->nsorted)
+	{
+		uint32	nitems = eset->nall;
+		uint32	nnew = eset->nall - eset->nsorted;
+		double	ratio;
+
+		/*
+		 * sort the array with new items, but only when not already sorted
+		 *
+		 * TODO Consider replacing this insert-sort for small number of items
+		 * (for <64 items it might be faster than qsort)
+		 */
+		if (count_distinct_track_stats)
+			INSTR_TIME_SET_CURRENT(start_time);
+
+		sort_items(eset, base, eset->nall - eset->nsorted);
+
+		eset->ncompactions += 1;
+
+		if (count_distinct_track_stats)
+		{
+			INSTR_TIME_SET_CURRENT(sort_time);
+			INSTR_TIME_SUBTRACT(sort_time, start_time);
+
+			stats.compactions += 1;
+			stats.sort_time += INSTR_TIME_GET_MICROSEC(sort_time);
+		}
+
+		/* Remove duplicate values from the sorted array. */
+		cnt = dedup_sorted(eset, base, eset->nall - eset->nsorted);
+
+		/* duplicities removed -> update the number of items in this part */
+		eset->nall = eset->nsorted + cnt;
+
+		/* If this is the first sorted part, we can just use it as the 'sorted' part. */
+		if (eset->nsorted == 0)
+			eset->nsorted = eset->nall;
+
+		/*
+		 * TODO Another optimization opportunity is that we don't really need to
+		 *		merge the arrays, if we freed enough space by processing the new
+		 *		items. We may postpone that until the last call (when finalizing
+		 *		the aggregate). OTOH if that happens, it shouldn't be that
+		 *		expensive to merge because the number of new items will be small
+		 *		(as we've removed a enough duplicities). But we still need to
+		 *		shuffle the data around, which wastes memory bandwidth.
+		 */
+
+		/* If a merge is needed, walk through the arrays and keep unique values. */
+		if (eset->nsorted < eset->nall)
+		{
+			/* allocate new array for the result */
+			char * data = alloc_memory(eset->alloc, eset->nbytes);
+			char * ptr = data;
+
+			/* already sorted array */
+			char * a = eset->data;
+			char * a_max = eset->data + (Size) eset->nsorted * eset->itemlen;
+
+			/* the new array */
+			char * b = eset->data + ((Size) eset->nsorted * eset->itemlen);
+			char * b_max = eset->data + (Size) eset->nall * eset->itemlen;
+
+			TRACE_COUNT_DISTINCT_MERGE_START(eset->nsorted,
+											 eset->nall - eset->nsorted,
+											 eset->typlen);
+
+			/*
+			 * TODO There's a possibility for optimization - if we get already
+			 *		sorted items (e.g. because of a subplan), we can just copy the
+			 *		arrays. The check is as simple as checking
+			 *
+			 *		(a_first > b_last) || (a_last < b_first).
+			 *
+			 *		OTOH this is probably very unlikely to happen in practice.
+			 */
+			if ((count_distinct_max_threads > 1) &&
+				((Size) eset->nall * eset->itemlen >= THREADS_MIN_SIZE))
+			{
+				uint32	nchunks = count_distinct_max_threads * TASKS_PER_THREAD;
+				uint32 *bounds = palloc(3 * (nchunks + 1) * sizeof(uint32));
+
+				ptr = merge_items_parallel(eset, a, eset->nsorted,
+										   b, eset->nall - eset->nsorted,
+										   ptr, nchunks,
+										   count_distinct_max_threads, bounds);
+
+				pfree(bounds);
+			}
+			else
+				ptr = merge_items(eset, a, a_max, b, b_max, ptr, 0);
+
+			Assert((ptr - data) <= ((Size) eset->nall * eset->itemlen));
+
+			STATS_ADD(merges, 1);
+			STATS_ADD(bytes_copied, ptr - data);
+
+			/*
+			 * Update the counts with the result of the merge (there might be
+			 * duplicities between the two parts, and we have eliminated them).
+			 */
+			eset->nsorted = (ptr - data) / eset->itemlen;
+			eset->nall = eset->nsorted;
+			free_data(eset);
+			eset->data = data;
+
+			TRACE_COUNT_DISTINCT_MERGE_DONE(eset->nall);
+		}
+
+		/*
+		 * Fraction of the new items that were duplicates (of other new items
+		 * or of the sorted part), so always between 0 and 1. The average is
+		 * exponentially weighted (see DEDUP_RATIO_WEIGHT), and starts at the
+		 * ratio of the first compaction.
+		 */
+		ratio = (double) (nitems - eset->nall) / nnew;
+
+		if (eset->ncompactions == 1)
+			eset->dedup_ratio = ratio;
+		else
+			eset->dedup_ratio = DEDUP_RATIO_WEIGHT * ratio +
+				(1.0 - DEDUP_RATIO_WEIGHT) * eset->dedup_ratio;
+	}
+
+	Assert(eset->nall == eset->nsorted);
+
+	/* compute free space as a fraction of the total size */
+	free_fract
+		= (eset->nbytes - (Size) eset->nall * eset->itemlen) * 1.0 / eset->nbytes;
+
+	/*
+	 * If we need space for more items (e.g. not when finalizing the aggregate
+	 * result), enlarge the array when needed. We require free_space of the
+	 * array to be free, and space for at least one more item (with long
+	 * items the free space may be less than an item).
+	 */
+	if (need_space &&
+		((free_fract < count_distinct_free_space) ||
+		 (eset->nbytes - (Size) eset->nall * eset->itemlen < eset->itemlen)))
+	{
+		Size	used = (Size) eset->nall * eset->itemlen;
+		Size	nbytes;
+
+		/*
+		 * How fast to grow depends on the duplicates removed by compactions.
+		 * When they remove almost nothing (mostly distinct values), compacting
+		 * again soon would just merge the whole array for no gain, so we
+		 * double the array (the number of compactions is then logarithmic).
+		 * When they remove a lot (duplicate-heavy data), the compactions keep
+		 * freeing space, and we only grow just enough to get the free space.
+		 *
+		 * Otherwise, for small requests, we simply double the array size,
+		 * because that's what AllocSet will give use anyway. No point in
+		 * trying to save memory by growing the array slower.
+		 *
+		 * After reaching ALLOCSET_SEPARATE_THRESHOLD, the memory is allocated
+		 * in separate blocks, thus we can be smarter and grow the memory
+		 * a bit slower (just enough to get the free space).
+		 *
+		 * XXX If the memory context uses smaller blocks, the switch to special
+		 * blocks may happen before ALLOCSET_SEPARATE_THRESHOLD. This limit
+		 * is simply global guarantee for all possible AllocSets.
+		 *
+		 * Whatever the ratio, the array at most doubles (with a large free
+		 * space the slow growth might be faster than that), and there's
+		 * always space for at least one more item.
+		 */
+		if (eset->dedup_ratio < count_distinct_fast_growth_ratio)
+			nbytes = eset->nbytes * 2;
+		else if (eset->dedup_ratio >= count_distinct_slow_growth_ratio)
+			nbytes = used / (1.0 - count_distinct_free_space);
+		else if ((eset->nbytes / (1.0 - count_distinct_free_space)) < ALLOCSET_SEPARATE_THRESHOLD)
+			nbytes = eset->nbytes * 2;
+		else
+			nbytes = eset->nbytes / (1.0 - count_distinct_free_space);
+
+		nbytes = Min(nbytes, eset->nbytes * 2);
+
+		resize_data(eset, Max(nbytes, used + eset->itemlen));
+	}
+
+	TRACE_COUNT_DISTINCT_COMPACT_DONE(eset->nall, eset->nbytes);
+}
+
+/*
+ * sort the new (unsorted) items
+ *
+ * With sets of hundreds of millions of values, the new items collected
+ * between compactions may be much larger than the CPU caches, and a single
+ * qsort over all of them suffers from cache misses. So with partition_bits
+ * set, large batches are first partitioned by the top bits of the keys (see
+ * partition_items) into 2^k ranges, which are then sorted one by one, each
+ * small enough to stay in cache. The partitions are ranges of keys, so the
+ * result is exactly the same as after sorting all the items at once (and
+ * the deduplication and merge work unchanged).
+ *
+ * With max_threads set, the partitions of large batches are sorted by
+ * multiple threads (with at least TASKS_PER_THREAD partitions per thread,
+ * even when partition_bits is not set).
+ */
+static void
+sort_items(element_set_t *eset, char *base, uint32 nitems)
+{
+	int		nbits = count_distinct_partition_bits;
+	int		nthreads = 1;
+	int		nparts;
+	uint32 *bounds;
+	char   *tmp;
+
+	if ((count_distinct_max_threads > 1) &&
+		((Size) nitems * eset->itemlen >= THREADS_MIN_SIZE))
+	{
+		nthreads = count_distinct_max_threads;
+
+		while ((nbits < PARTITION_MAX_BITS) &&
+			   ((1 << nbits) < nthreads * TASKS_PER_THREAD))
+			nbits++;
+	}
+
+	if ((nbits == 0) ||
+		((Size) nitems * eset->itemlen < PARTITION_MIN_SIZE))
+	{
+		qsort_arg(base, nitems, eset->itemlen, get_compare_func(eset), eset);
+		return;
+	}
+
+	nparts = (1 << nbits);
+	bounds = (uint32 *) palloc((2 * nparts + 1) * sizeof(uint32));
+	tmp = palloc(eset->itemlen);
+
+	partition_items(eset, base, nitems, nbits, bounds, bounds + nparts + 1, tmp);
+
+	sort_partitions(eset, base, bounds, nparts, nthreads);
+
+	pfree(bounds);
+	pfree(tmp);
+}
+
+static void
+add_element(element_set_t *eset, Datum value)
+{
+	bool	small;
+
+	/*
+	 * If there's not enough space for another item, perform compaction
+	 * (this also allocates enough free space for new entries).
+	 */
+	if ((Size) eset->itemlen * (eset->nall + 1) > eset->nbytes)
+		compact_set(eset, true);
+
+	/* there needs to be space for at least one more value (thanks to the compaction) */
+	Assert(eset->nbytes >= (Size) eset->itemlen * (eset->nall + 1));
+
+	/*
+	 * Small sets (still using the initial data array) are kept sorted and
+	 * without duplicates, unless we already added unsorted items in bulk.
+	 */
+	small = ((eset->nbytes <= ARRAY_INIT_SIZE) &&
+			 (eset->nsorted == eset->nall) &&
+			 (eset->itemlen <= SMALL_ITEM_MAX));
+
+	/* variable-length values need to be stored in the arena first */
+	if (eset->typlen == -1)
+		add_varlena(eset, value);
+	else
+	{
+		/* now we're sure there's enough space */
+		copy_value(eset, eset->data + ((Size) eset->itemlen * eset->nall), value);
+		eset->nall += 1;
+	}
+
+	/* the value was seen once (so far) */
+	if (SET_IS_COUNTED(eset))
+	{
+		uint64	count = 1;
+
+		memcpy(ITEM_COUNT(eset, eset->data + (Size) eset->itemlen * (eset->nall - 1)),
+			   &count, sizeof(uint64));
+	}
+
+	if (small)
+		insert_item(eset);
+}
+
+/*
+ * move the last (just added) item to the right place in the sorted part,
+ * or discard it if it's a duplicate
+ *
+ * Used for small sets, where a linear search is cheaper than accumulating
+ * the items and then sorting them (and it also keeps duplicates out of the
+ * small data array, so that it lasts longer).
+ */
+static void
+insert_item(element_set_t *eset)
+{
+	qsort_arg_comparator	cmp = get_compare_func(eset);
+	char   *item = eset->data + (Size) eset->itemlen * (eset->nall - 1);
+	char   *ptr;
+	int		r = 1;
+	char	tmp[SMALL_ITEM_MAX];
+
+	Assert(eset->nsorted == eset->nall - 1);
+	Assert(eset->itemlen <= SMALL_ITEM_MAX);
+
+	/* find the first item not smaller than the new one */
+	for (ptr = eset->data; ptr < item; ptr += eset->itemlen)
+	{
+		r = cmp(ptr, item, eset);
+		if (r >= 0)
+			break;
+	}
+
+	if (r == 0)
+	{
+		/* duplicate - discard the item (and the value in the arena) */
+		if (eset->typlen == -1)
+			eset->arena_used = ((varlena_item_t *) item)->offset;
+
+		if (SET_IS_COUNTED(eset))
+			add_item_count(eset, ptr, item);
+
+		eset->nall -= 1;
+		return;
+	}
+
+	/* shift the larger items to make space for the new one */
+	if (ptr < item)
+	{
+		memcpy(tmp, item, eset->itemlen);
+		memmove(ptr + eset->itemlen, ptr, item - ptr);
+		memcpy(ptr, tmp, eset->itemlen);
+	}
+
+	eset->nsorted = eset->nall;
+}
+
+/*
+ * add all non-NULL elements of the array into the set
+ *
+ * We don't deconstruct the array, but walk the data area directly. When the
+ * elements are stored without any alignment padding (fixed-length types with
+ * typlen matching the alignment, i.e. all the usual ones), the layout of the
+ * data area is the same as in our data array. So we make sure there's space
+ * for all the elements at once, and then simply copy the data - using a
+ * single memcpy when there are no NULLs - and transform the keys in place.
+ */
+static void
+add_elements(element_set_t *eset, ArrayType *input, int nelements)
+{
+	char   *src = ARR_DATA_PTR(input);
+	bits8  *bitmap = ARR_NULLBITMAP(input);
+	int		bitmask = 1;
+	int		i;
+
+	Assert(!SET_IS_COUNTED(eset));
+
+	if ((eset->typlen > 0) &&
+		(att_align_nominal(eset->typlen, eset->typalign) == eset->typlen))
+	{
+		char   *dst;
+		int		nvalues = 0;
+
+		reserve_space(eset, nelements);
+
+		dst = eset->data + ((Size) eset->itemlen * eset->nall);
+
+		if (bitmap == NULL)
+		{
+			memcpy(dst, src, (Size) nelements * eset->typlen);
+			nvalues = nelements;
+		}
+		else
+		{
+			for (i = 0; i < nelements; i++)
+			{
+				/* NULL elements take no space in the data area */
+				if (*bitmap & bitmask)
+				{
+					memcpy(dst + (nvalues * eset->typlen), src, eset->typlen);
+					src += eset->typlen;
+					nvalues++;
+				}
+
+				bitmask <<= 1;
+				if (bitmask == 0x100)
+				{
+					bitmap++;
+					bitmask = 1;
+				}
+			}
+		}
+
+		/* transform the values into keys */
+		if (SET_TYPBYVAL(eset))
+		{
+			for (i = 0; i < nvalues; i++)
+				encode_key(eset->keykind, dst + (i * eset->typlen), eset->typlen);
+		}
+
+		eset->nall += nvalues;
+
+		return;
+	}
+
+	/* otherwise walk the elements one by one, just like deconstruct_array */
+	for (i = 0; i < nelements; i++)
+	{
+		if ((bitmap == NULL) || (*bitmap & bitmask))
+		{
+			add_element(eset, fetch_att(src, SET_TYPBYVAL(eset), eset->typlen));
+
+			src = att_addlength_pointer(src, eset->typlen, src);
+			src = (char *) att_align_nominal(src, eset->typalign);
+		}
+
+		if (bitmap)
+		{
+			bitmask <<= 1;
+			if (bitmask == 0x100)
+			{
+				bitmap++;
+				bitmask = 1;
+			}
+		}
+	}
+}
+
+/* does the array have at least one non-NULL element? */
+static bool
+array_has_values(ArrayType *input, int nelements)
+{
+	bits8  *bitmap = ARR_NULLBITMAP(input);
+	int		i;
+
+	if (bitmap == NULL)
+		return (nelements > 0);
+
+	for (i = 0; i < nelements; i++)
+	{
+		if (bitmap[i / 8] & (1 << (i % 8)))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * make sure there's space for nitems more items in the data array
+ *
+ * We try compaction first (which also allocates the free space), and if
+ * that's not enough we grow the array to fit all the items (plus the usual
+ * free space).
+ */
+static void
+reserve_space(element_set_t *eset, int nitems)
+{
+	Size	needed = (Size) (eset->nall + nitems) * eset->itemlen;
+
+	if (needed <= eset->nbytes)
+		return;
+
+	if (eset->nall > 0)
+	{
+		compact_set(eset, true);
+		needed = (Size) (eset->nall + nitems) * eset->itemlen;
+	}
+
+	if (needed > eset->nbytes)
+		resize_data(eset, Max(eset->nbytes * 2, needed / (1.0 - count_distinct_free_space)));
+
+	Assert(eset->nbytes >= (Size) (eset->nall + nitems) * eset->itemlen);
+}
+
+/*
+ * get information about the element type (of the second argument, or of its
+ * elements for arrays), looked up on the first call and cached in fn_extra
+ */
+static element_info_t *
+get_element_info(FunctionCallInfo fcinfo, bool elements)
+{
+	element_info_t *info = (element_info_t *) fcinfo->flinfo->fn_extra;
+	Oid			element_type;
+
+	if (info != NULL)
+		return info;
+
+	info = (element_info_t *) MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+												 sizeof(element_info_t));
+
+	element_type = get_fn_expr_argtype(fcinfo->flinfo, 1);
+
+	if (elements)
+		element_type = get_element_type(element_type);
+
+	lookup_element_info(info, element_type);
+
+	fcinfo->flinfo->fn_extra = info;
+
+	return info;
+}
+
+/* fill the element type information (does the catalog lookups) */
+static void
+lookup_element_info(element_info_t *info, Oid element_type)
+{
+	info->element_type = element_type;
+
+	get_typlenbyvalalign(info->element_type,
+						 &info->typlen, &info->typbyval, &info->typalign);
+
+	/* we can't handle cstrings (or other non-varlena variable-length types) */
+	if (info->typlen < -1)
+		elog(ERROR, "count_distinct handles only fixed-length and varlena types");
+
+	info->keykind = get_key_kind(info->element_type, info->typlen,
+								 info->typbyval);
+}
+
+/*
+ * get information about the columns of the multi-column variants (and the
+ * composite key), looked up on the first call and cached in fn_extra
+ */
+static composite_info_t *
+get_composite_info(FunctionCallInfo fcinfo)
+{
+	composite_info_t   *cinfo = (composite_info_t *) fcinfo->flinfo->fn_extra;
+	int		ncolumns = PG_NARGS() - 1;
+	int		keylen = 0;
+	bool	byval = true;
+	int		i;
+
+	if (cinfo != NULL)
+		return cinfo;
+
+	cinfo = (composite_info_t *) MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+							offsetof(composite_info_t, columns) +
+							ncolumns * sizeof(element_info_t));
+
+	cinfo->ncolumns = ncolumns;
+
+	for (i = 0; i < ncolumns; i++)
+	{
+		element_info_t *column = &cinfo->columns[i];
+
+		lookup_element_info(column, get_fn_expr_argtype(fcinfo->flinfo, i + 1));
+
+		if (column->typlen < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("count_distinct with multiple arguments handles only fixed-length types")));
+
+		keylen += column->typlen;
+		byval = byval && column->typbyval;
+	}
+
+	cinfo->info.element_type = InvalidOid;
+
+	if (byval && (keylen <= sizeof(Datum)))
+	{
+		cinfo->info.typlen = sizeof(Datum);
+		cinfo->info.typbyval = true;
+		cinfo->info.typalign = (sizeof(Datum) == 8) ? 'd' : 'i';
+		cinfo->info.keykind = KEY_UNSIGNED;
+		cinfo->key = NULL;
+	}
+	else
+	{
+		cinfo->info.typlen = Max(keylen, 16);
+		cinfo->info.typbyval = false;
+		cinfo->info.typalign = 'c';
+		cinfo->info.keykind = KEY_BINARY;
+		cinfo->key = MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt,
+											cinfo->info.typlen);
+	}
+
+	fcinfo->flinfo->fn_extra = cinfo;
+
+	return cinfo;
+}
+
+/*
+ * pack values of the columns (arguments 1..n) into a composite key, in the
+ * format expected by add_element (a Datum, or a pointer to the binary key)
+ */
+static Datum
+pack_composite(composite_info_t *cinfo, FunctionCallInfo fcinfo)
+{
+	uint64	key = 0;
+	char   *ptr = cinfo->key;
+	int		i;
+
+	for (i = 0; i < cinfo->ncolumns; i++)
+	{
+		element_info_t *column = &cinfo->columns[i];
+		Datum	value = PG_GETARG_DATUM(i + 1);
+		uint64	ckey;
+		int		j;
+
+		/* values passed by reference are simply copied */
+		if (!column->typbyval)
+		{
+			memcpy(ptr, DatumGetPointer(value), column->typlen);
+			ptr += column->typlen;
+			continue;
+		}
+
+		/* transform the value into a key (unsigned integer) */
+		switch (column->typlen)
+		{
+			case 1:
+			{
+				uint8	k;
+
+				store_att_byval(&k, value, 1);
+				encode_key(column->keykind, (char *) &k, 1);
+				ckey = k;
+				break;
+			}
+			case 2:
+			{
+				uint16	k;
+
+				store_att_byval(&k, value, 2);
+				encode_key(column->keykind, (char *) &k, 2);
+				ckey = k;
+				break;
+			}
+			case 4:
+			{
+				uint32	k;
+
+				store_att_byval(&k, value, 4);
+				encode_key(column->keykind, (char *) &k, 4);
+				ckey = k;
+				break;
+			}
+			default:
+			{
+				uint64	k;
+
+				Assert(column->typlen == 8);
+
+				store_att_byval(&k, value, 8);
+				encode_key(column->keykind, (char *) &k, 8);
+				ckey = k;
+				break;
+			}
+		}
+
+		if (ptr == NULL)
+		{
+			/* the keys are shorter than 8 bytes, so the shift is fine */
+			key = (key << (8 * column->typlen)) | ckey;
+			continue;
+		}
+
+		for (j = column->typlen - 1; j >= 0; j--)
+			*ptr++ = (char) ((ckey >> (8 * j)) & 0xFF);
+	}
+
+	if (cinfo->key == NULL)
+		return (Datum) key;
+
+	return PointerGetDatum(cinfo->key);
+}
+
+/*
+ * XXX make sure the whole method is called within the aggregate context
+ *
+ * The header, the initial data array and the arena (for varlena types) are
+ * allocated as a single chunk (see state_allocator_t).
+ */
+static element_set_t *
+init_set(element_info_t *info, MemoryContext ctx, bool counted)
+{
+	element_set_t  *eset;
+	int16	typlen = info->typlen;
+	int16	itemlen = ((typlen == -1) ? sizeof(varlena_item_t) : typlen) +
+					  (counted ? sizeof(uint64) : 0);
+
+	/* make sure there's space for a couple items even for long types */
+	Size	nbytes = MAXALIGN(Max(ARRAY_INIT_SIZE, 2 * itemlen));
+	Size	hlen = MAXALIGN(sizeof(element_set_t));
+	Size	alen = (typlen == -1) ? ARENA_INIT_SIZE : 0;
+	state_allocator_t  *alloc = get_allocator(ctx);
+	char   *chunk = alloc_state(alloc, hlen + nbytes + alen);
+
+	eset = (element_set_t *) chunk;
+
+	eset->typlen = typlen;
+	eset->typalign = info->typalign;
+	eset->keykind = info->keykind;
+	eset->itemlen = itemlen;
+	eset->nsorted = 0;
+	eset->nall = 0;
+	eset->alloc = alloc;
+
+	eset->nbytes = nbytes;
+	eset->data = chunk + hlen;
+	eset->flags = SET_DATA_INLINE | (counted ? SET_COUNTED : 0);
+	eset->argument = 0;
+
+	eset->arena = NULL;
+	eset->arena_used = 0;
+	eset->arena_size = 0;
+	eset->ncompactions = 0;
+	eset->dedup_ratio = 0;
+
+	if (typlen == -1)
+	{
+		eset->arena_size = alen;
+		eset->arena = chunk + hlen + nbytes;
+		eset->flags |= SET_ARENA_INLINE;
+	}
+
+	return eset;
+}
+
+/*
+ * get the allocator for the aggregate context (create it if needed)
+ */
+static state_allocator_t *
+get_allocator(MemoryContext ctx)
+{
+	state_allocator_t  *alloc;
+
+	for (alloc = allocators; alloc != NULL; alloc = alloc->next)
+	{
+		if (alloc->ctx == ctx)
+			return alloc;
+	}
+
+	alloc = (state_allocator_t *) MemoryContextAlloc(ctx, sizeof(state_allocator_t));
+
+	alloc->ctx = ctx;
+	alloc->ptr = NULL;
+	alloc->avail = 0;
+	alloc->blksize = STATE_BLOCK_MIN;
+	alloc->allocated = 0;
+
+	/* forget the allocator when the context gets reset or deleted */
+	alloc->callback.func = release_allocator;
+	alloc->callback.arg = alloc;
+	MemoryContextRegisterResetCallback(ctx, &alloc->callback);
+
+	alloc->next = allocators;
+	allocators = alloc;
+
+	return alloc;
+}
+
+/*
+ * allocate a chunk for a new state, from the current block of the allocator
+ * (or directly, for large states)
+ */
+static char *
+alloc_state(state_allocator_t *alloc, Size size)
+{
+	char   *ptr;
+
+	size = MAXALIGN(size);
+
+	if (size > STATE_BLOCK_MAX / 4)
+		return alloc_memory(alloc, size);
+
+	/* not enough space in the current block (the remainder gets wasted) */
+	if (size > alloc->avail)
+	{
+		alloc->ptr = alloc_memory(alloc, alloc->blksize);
+		alloc->avail = alloc->blksize;
+		alloc->blksize = Min(alloc->blksize * 2, STATE_BLOCK_MAX);
+	}
+
+	ptr = alloc->ptr;
+	alloc->ptr += size;
+	alloc->avail -= size;
+
+	return ptr;
+}
+
+/*
+ * reset callback - the memory was released with the context, so remove the
+ * allocator from the list and uncharge the memory
+ */
+static void
+release_allocator(void *arg)
+{
+	state_allocator_t  *alloc = (state_allocator_t *) arg;
+	state_allocator_t **prev = &allocators;
+
+	Assert(total_allocated >= alloc->allocated);
+	total_allocated -= alloc->allocated;
+
+	while (*prev != NULL)
+	{
+		if (*prev == alloc)
+		{
+			*prev = alloc->next;
+			break;
+		}
+
+		prev = &(*prev)->next;
+	}
+}
+
+/* allocate memory in the context of the allocator (may be huge) */
+static void *
+alloc_memory(state_allocator_t *alloc, Size size)
+{
+	charge_memory(alloc, size);
+
+	return MemoryContextAllocHuge(alloc->ctx, size);
+}
+
+/* resize a chunk allocated by alloc_memory (charging only the difference) */
+static void *
+realloc_memory(state_allocator_t *alloc, void *ptr, Size oldsize, Size newsize)
+{
+	if (newsize > oldsize)
+		charge_memory(alloc, newsize - oldsize);
+	else
+	{
+		alloc->allocated -= (oldsize - newsize);
+		total_allocated -= (oldsize - newsize);
+	}
+
+	return repalloc_huge(ptr, newsize);
+}
+
+/* free a chunk allocated by alloc_memory */
+static void
+free_memory(state_allocator_t *alloc, void *ptr, Size size)
+{
+	Assert(alloc->allocated >= size);
+
+	alloc->allocated -= size;
+	total_allocated -= size;
+
+	pfree(ptr);
+}
+
+/*
+ * charge memory to the allocator (and the backend total), and fail if that
+ * would exceed count_distinct.max_memory
+ */
+static void
+charge_memory(state_allocator_t *alloc, Size size)
+{
+	if ((count_distinct_max_memory >= 0) &&
+		(total_allocated + size > (Size) count_distinct_max_memory * 1024))
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+				 errmsg("count_distinct memory usage exceeds count_distinct.max_memory (%dkB)",
+						count_distinct_max_memory),
+				 errdetail("Failed on request of size %zu, with %zu bytes already allocated.",
+						   size, total_allocated)));
+
+	alloc->allocated += size;
+	total_allocated += size;
+}
+
+/*
+ * resize the data array (keeping the items), when allocated with the header
+ * allocate a new chunk instead
+ */
+static void
+resize_data(element_set_t *eset, Size nbytes)
+{
+	Assert(nbytes >= (Size) eset->nall * eset->itemlen);
+
+	TRACE_COUNT_DISTINCT_RESIZE_START(eset->nbytes, nbytes, 0);
+
+	if (eset->flags & SET_DATA_INLINE)
+	{
+		char   *data = alloc_memory(eset->alloc, nbytes);
+
+		memcpy(data, eset->data, (Size) eset->nall * eset->itemlen);
+
+		eset->data = data;
+		eset->flags &= ~SET_DATA_INLINE;
+	}
+	else
+		eset->data = realloc_memory(eset->alloc, eset->data, eset->nbytes, nbytes);
+
+	eset->nbytes = nbytes;
+
+	TRACE_COUNT_DISTINCT_RESIZE_DONE(nbytes, 0);
+
+	STATS_ADD(reallocations, 1);
+	STATS_PEAK(eset);
+}
+
+/* free the data array (unless it's allocated with the header) */
+static void
+free_data(element_set_t *eset)
+{
+	if (eset->flags & SET_DATA_INLINE)
+		eset->flags &= ~SET_DATA_INLINE;
+	else
+		free_memory(eset->alloc, eset->data, eset->nbytes);
+}
+
+/*
+ * serialize the set into a bytea value (used both for parallel aggregation
+ * and as the on-disk format of distinct_set)
+ */
+static bytea *
+serialize_set(element_set_t *eset)
+{
+	serial_header_t hdr;
+	Size	hlen = sizeof(serial_header_t);			/* header */
+	Size	dlen;									/* elements */
+	Size	alen = 0;								/* arena */
+	Size	packed PG_USED_FOR_ASSERTS_ONLY;
+	bytea  *out;									/* output */
+	char   *ptr;
+
+	/*
+	 * force compaction, so that we serialize the smallest amount of data
+	 * and also make sure the data is sorted (and the sort happens in the
+	 * parallel workers, ot distribute the CPU better)
+	 */
+	compact_set(eset, false);
+
+	Assert(eset->nall > 0);
+	Assert(eset->nall == eset->nsorted);
+
+	dlen = (Size) eset->nall * eset->itemlen;
+
+	/* for varlena we only serialize values referenced by the items */
+	if (eset->typlen == -1)
+		alen = packed_arena_size(eset);
+
+	out = (bytea *) palloc(VARHDRSZ + dlen + hlen + alen);
+
+	SET_VARSIZE(out, VARHDRSZ + dlen + hlen + alen);
+	ptr = VARDATA(out);
+
+	/* the header describes the serialized (packed) arena */
+	memset(&hdr, 0, hlen);
+	hdr.nall = eset->nall;
+	hdr.arena_used = alen;
+	hdr.typlen = eset->typlen;
+	hdr.itemlen = eset->itemlen;
+	hdr.typalign = eset->typalign;
+	hdr.keykind = eset->keykind;
+	hdr.version = SERIAL_FORMAT_VERSION;
+	hdr.flags = SET_IS_COUNTED(eset) ? SERIAL_COUNTED : 0;
+	hdr.argument = eset->argument;
+
+	memcpy(ptr, &hdr, hlen);
+	ptr += hlen;
+
+	/* the items, and for varlena the values (in item order) */
+	packed = pack_items(eset, ptr, ptr + dlen);
+
+	Assert(packed == alen);
+
+	return out;
+}
+
+/*
+ * build a set from the serialized value, allocated in the current memory
+ * context (the value is expected to be valid, e.g. produced by serialize_set)
+ */
+static element_set_t *
+deserialize_set(bytea *state)
+{
+	element_set_t *eset;
+	serial_header_t	hdr;
+	Size	len PG_USED_FOR_ASSERTS_ONLY = VARSIZE_ANY_EXHDR(state);
+	char   *ptr = VARDATA_ANY(state);
+	Size	hlen = MAXALIGN(sizeof(element_set_t));
+	Size	dlen;
+	char   *chunk;
+	state_allocator_t  *alloc;
+
+	Assert(len > sizeof(serial_header_t));
+
+	/* copy the header */
+	memcpy(&hdr, ptr, sizeof(serial_header_t));
+	ptr += sizeof(serial_header_t);
+
+	if (hdr.version != SERIAL_FORMAT_VERSION)
+		elog(ERROR, "unsupported distinct set format version %d", hdr.version);
+
+	dlen = (Size) hdr.nall * hdr.itemlen;
+
+	Assert(hdr.nall > 0);
+	Assert(len == sizeof(serial_header_t) + dlen + hdr.arena_used);
+
+	/*
+	 * The state is allocated in the current memory context, as a single
+	 * chunk with just the necessary space for the data and the arena.
+	 */
+	alloc = get_allocator(CurrentMemoryContext);
+	chunk = alloc_memory(alloc, hlen + MAXALIGN(dlen) + hdr.arena_used);
+	eset = (element_set_t *) chunk;
+
+	eset->alloc = alloc;
+	eset->typlen = hdr.typlen;
+	eset->typalign = hdr.typalign;
+	eset->keykind = hdr.keykind;
+	eset->itemlen = hdr.itemlen;
+	eset->nall = hdr.nall;
+	eset->nsorted = hdr.nall;
+	eset->flags = SET_DATA_INLINE;
+	eset->argument = hdr.argument;
+
+	if (hdr.flags & SERIAL_COUNTED)
+		eset->flags |= SET_COUNTED;
+
+	eset->nbytes = dlen;
+	eset->data = chunk + hlen;
+
+	memcpy(eset->data, ptr, dlen);
+	ptr += dlen;
+
+	/* the values of varlena types follow the items */
+	eset->arena = NULL;
+	eset->arena_used = 0;
+	eset->arena_size = 0;
+	eset->ncompactions = 0;
+	eset->dedup_ratio = 0;
+
+	if (eset->typlen == -1)
+	{
+		eset->arena = chunk + hlen + MAXALIGN(dlen);
+		eset->arena_used = hdr.arena_used;
+		eset->arena_size = hdr.arena_used;
+		eset->flags |= SET_ARENA_INLINE;
+
+		memcpy(eset->arena, ptr, eset->arena_used);
+	}
+
+	return eset;
+}
+
+/*
+ * merge the second set into the first one (the second one is compacted, but
+ * otherwise remains unchanged)
+ *
+ * The merge happens in place - the data array of the first set is resized
+ * to exactly the size needed for the items of both sets (unless it's large
+ * enough already), and the sets are merged from the end (see
+ * merge_sorted_backward). So we never need memory for another array with
+ * both sets (and the free space of both), while the old one still exists.
+ * That matters for the leader of a parallel aggregate, combining states of
+ * all the workers into a single one.
+ */
+static void
+merge_sets(element_set_t *eset1, element_set_t *eset2)
+{
+	char   *start,
+		   *end;
+	Size	nbytes;
+	Size	shift = 0;
+
+	/* the sets may come from distinct_set values, so check them properly */
+	check_compatible(eset1, eset2);
+
+	/* make sure both states are sorted */
+	compact_set(eset1, false);
+	compact_set(eset2, false);
+
+	nbytes = (Size) (eset1->nall + eset2->nall) * eset1->itemlen;
+
+	if (nbytes > eset1->nbytes)
+		resize_data(eset1, nbytes);
+
+	TRACE_COUNT_DISTINCT_MERGE_START(eset1->nall, eset2->nall, eset1->typlen);
+
+	/* copy values from the second arena, items need to be shifted */
+	if (eset1->typlen == -1)
+		shift = append_arena(eset1, eset2);
+
+	/* merge the two arrays (both are sorted and free of duplicates) */
+	end = eset1->data + nbytes;
+	start = merge_items_backward(eset1,
+								 eset1->data, eset1->data + (Size) eset1->nall * eset1->itemlen,
+								 eset2->data, eset2->data + (Size) eset2->nall * eset2->itemlen,
+								 end, shift);
+
+	Assert(start >= eset1->data);
+
+	/* we might have eliminated some duplicates, so move the items to the start */
+	if (start != eset1->data)
+		memmove(eset1->data, start, end - start);
+
+	STATS_ADD(merges, 1);
+	STATS_ADD(bytes_copied, end - start);
+
+	/* and finally compute the current number of elements */
+	eset1->nall = (end - start) / eset1->itemlen;
+	eset1->nsorted = eset1->nall;
+
+	TRACE_COUNT_DISTINCT_MERGE_DONE(eset1->nall);
+
+	STATS_PEAK(eset1);
+}
+
+/*
+ * add all items of the other set into the unsorted part of the set (and the
+ * values into the arena), the compaction takes care of duplicates
+ */
+static void
+append_set(element_set_t *eset, element_set_t *other)
+{
+	check_compatible(eset, other);
+
+	reserve_space(eset, other->nall);
+
+	if (eset->typlen == -1)
+	{
+		uint32	i;
+		Size	shift;
+
+		/* repack the arena first, if there's not enough space */
+		if (MAXALIGN(eset->arena_used) + other->arena_used > eset->arena_size)
+			reserve_arena(eset, other->arena_used);
+
+		shift = append_arena(eset, other);
+
+		for (i = 0; i < other->nall; i++)
+		{
+			varlena_item_t *item
+				= (varlena_item_t *) (eset->data + (Size) (eset->nall + i) * eset->itemlen);
+
+			memcpy(item, other->data + (Size) i * other->itemlen, other->itemlen);
+			item->offset += shift;
+		}
+	}
+	else
+		memcpy(eset->data + (Size) eset->nall * eset->itemlen, other->data,
+			   (Size) other->nall * other->itemlen);
+
+	eset->nall += other->nall;
+}
+
+/* make sure the sets contain values of the same type (as far as we know) */
+static void
+check_compatible(element_set_t *eset1, element_set_t *eset2)
+{
+	if ((eset1->typlen != eset2->typlen) ||
+		(eset1->typalign != eset2->typalign) ||
+		(eset1->keykind != eset2->keykind) ||
+		(SET_IS_COUNTED(eset1) != SET_IS_COUNTED(eset2)))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				 errmsg("cannot merge distinct sets of different data types")));
+
+	if (eset1->argument != eset2->argument)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("the argument has to be the same for all rows in a group")));
+}
+
+/*
+ * write the serialized set in the external format:
+ *
+ * - version (1B), byte order (1B), key kind (1B), typalign (1B), typlen (2B),
+ *	 items (4B)
+ * - keys of values passed by value as unsigned integers (typlen bytes)
+ * - values passed by reference as is (typlen bytes)
+ * - variable-length values as length (4B) followed by the data
+ *
+ * All integers are in network byte order, and items are in the set order.
+ * The keys of values passed by value are portable, but values passed by
+ * reference (fixed or variable length) are sent in their in-memory form,
+ * which may depend on the byte order (e.g. interval, or arrays), and the
+ * set does not know the data type to convert them. So the byte order is
+ * EXTERNAL_ORDER_NETWORK for keys, and the native one for other values
+ * (which read_set only accepts on a platform with the same byte order).
+ */
+static void
+write_set(StringInfo buf, bytea *value)
+{
+	serial_header_t	hdr;
+	char   *items;
+	char   *arena;
+	uint32	i;
+
+	if (VARSIZE_ANY_EXHDR(value) < sizeof(serial_header_t))
+		elog(ERROR, "invalid distinct_set value");
+
+	memcpy(&hdr, VARDATA_ANY(value), sizeof(serial_header_t));
+
+	if (hdr.version != SERIAL_FORMAT_VERSION)
+		elog(ERROR, "unsupported distinct set format version %d", hdr.version);
+
+	items = VARDATA_ANY(value) + sizeof(serial_header_t);
+	arena = items + (Size) hdr.nall * hdr.itemlen;
+
+	pq_sendbyte(buf, hdr.version);
+	pq_sendbyte(buf, ((hdr.keykind == KEY_BINARY) || (hdr.keykind == KEY_VARLENA)) ?
+				EXTERNAL_ORDER_NATIVE : EXTERNAL_ORDER_NETWORK);
+	pq_sendbyte(buf, hdr.keykind);
+	pq_sendbyte(buf, hdr.typalign);
+	pq_sendint16(buf, hdr.typlen);
+	pq_sendint32(buf, hdr.nall);
+
+	for (i = 0; i < hdr.nall; i++)
+	{
+		char   *item = items + (Size) i * hdr.itemlen;
+
+		switch (hdr.keykind)
+		{
+			case KEY_VARLENA:
+			{
+				varlena_item_t	vitem;
+
+				memcpy(&vitem, item, sizeof(varlena_item_t));
+
+				pq_sendint32(buf, vitem.length);
+				pq_sendbytes(buf, VARDATA(arena + vitem.offset), vitem.length);
+				break;
+			}
+
+			case KEY_BINARY:
+				pq_sendbytes(buf, item, hdr.typlen);
+				break;
+
+			default:
+			{
+				uint8	v1;
+				uint16	v2;
+				uint32	v4;
+				uint64	v8;
+
+				switch (hdr.typlen)
+				{
+					case 1:
+						memcpy(&v1, item, 1);
+						pq_sendbyte(buf, v1);
+						break;
+					case 2:
+						memcpy(&v2, item, 2);
+						pq_sendint16(buf, v2);
+						break;
+					case 4:
+						memcpy(&v4, item, 4);
+						pq_sendint32(buf, v4);
+						break;
+					case 8:
+						memcpy(&v8, item, 8);
+						pq_sendint64(buf, v8);
+						break;
+				}
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * read a set in the external format (see write_set), and return it in the
+ * serialized form (sorted and without duplicates)
+ */
+static bytea *
+read_set(StringInfo buf)
+{
+	int		version = pq_getmsgbyte(buf);
+	char	order;
+	char	keykind;
+	char	typalign;
+	int16	typlen;
+	uint32	nall;
+	bool	valid;
+	uint32	i;
+	element_info_t	info;
+	element_set_t  *eset;
+
+	if (version != SERIAL_FORMAT_VERSION)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+				 errmsg("unsupported distinct_set format version %d", version)));
+
+	order = pq_getmsgbyte(buf);
+	keykind = pq_getmsgbyte(buf);
+	typalign = pq_getmsgbyte(buf);
+	typlen = (int16) pq_getmsgint(buf, 2);
+	nall = (uint32) pq_getmsgint(buf, 4);
+
+	/* check the header (and that there's enough data for the items) */
+	switch (keykind)
+	{
+		case KEY_UNSIGNED:
+		case KEY_SIGNED:
+		case KEY_FLOAT:
+			valid = (typlen == 1 || typlen == 2 || typlen == 4 || typlen == 8) &&
+					(order == EXTERNAL_ORDER_NETWORK);
+			break;
+		case KEY_BINARY:
+			valid = (typlen > 0);
+			break;
+		case KEY_VARLENA:
+			valid = (typlen == -1);
+			break;
+		default:
+			valid = false;
+	}
+
+	/* values passed by reference are only readable with the same byte order */
+	if (valid && (order != EXTERNAL_ORDER_NETWORK) && (order != EXTERNAL_ORDER_NATIVE))
+	{
+		if ((order == EXTERNAL_ORDER_BIG) || (order == EXTERNAL_ORDER_LITTLE))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					 errmsg("distinct_set value was written on a platform with different byte order"),
+					 errdetail("Sets of values passed by reference can't be converted to a different byte order.")));
+
+		valid = false;
+	}
+
+	valid = valid &&
+		(typalign == 'c' || typalign == 's' || typalign == 'i' || typalign == 'd') &&
+		(nall > 0) &&
+		(nall <= (buf->len - buf->cursor) / ((typlen > 0) ? typlen : sizeof(uint32)));
+
+	if (!valid)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+				 errmsg("invalid distinct_set value")));
+
+	info.element_type = InvalidOid;
+	info.typlen = typlen;
+	info.typbyval = (keykind != KEY_BINARY) && (keykind != KEY_VARLENA);
+	info.typalign = typalign;
+	info.keykind = keykind;
+
+	eset = init_set(&info, CurrentMemoryContext, false);
+
+	reserve_space(eset, nall);
+
+	for (i = 0; i < nall; i++)
+	{
+		char   *item = eset->data + (Size) eset->nall * eset->itemlen;
+
+		switch (keykind)
+		{
+			case KEY_VARLENA:
+			{
+				int		len = pq_getmsgint(buf, 4);
+
+				add_varlena_bytes(eset, pq_getmsgbytes(buf, len), len);
+				break;
+			}
+
+			case KEY_BINARY:
+				memcpy(item, pq_getmsgbytes(buf, typlen), typlen);
+				eset->nall += 1;
+				break;
+
+			default:
+			{
+				uint8	v1;
+				uint16	v2;
+				uint32	v4;
+				uint64	v8;
+
+				switch (typlen)
+				{
+					case 1:
+						v1 = pq_getmsgbyte(buf);
+						memcpy(item, &v1, 1);
+						break;
+					case 2:
+						v2 = pq_getmsgint(buf, 2);
+						memcpy(item, &v2, 2);
+						break;
+					case 4:
+						v4 = pq_getmsgint(buf, 4);
+						memcpy(item, &v4, 4);
+						break;
+					case 8:
+						v8 = pq_getmsgint64(buf);
+						memcpy(item, &v8, 8);
+						break;
+				}
+
+				eset->nall += 1;
+				break;
+			}
+		}
+	}
+
+	pq_getmsgend(buf);
+
+	/* sorts the items and removes duplicates */
+	return serialize_set(eset);
+}
+
+/* value of a hex digit, or -1 for invalid characters */
+static int
+hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/*
+ * initialize a read-only set, referencing data of the serialized value (the
+ * items are sorted and without duplicates, so there's nothing to compact)
+ */
+static void
+set_from_value(element_set_t *eset, bytea *value)
+{
+	serial_header_t	hdr;
+	char   *ptr = VARDATA(value);
+
+	if (VARSIZE(value) < VARHDRSZ + sizeof(serial_header_t))
+		elog(ERROR, "invalid distinct_set value");
+
+	memcpy(&hdr, ptr, sizeof(serial_header_t));
+	ptr += sizeof(serial_header_t);
+
+	if (hdr.version != SERIAL_FORMAT_VERSION)
+		elog(ERROR, "unsupported distinct set format version %d", hdr.version);
+
+	/* values stored in a tuple may not be aligned enough for the items */
+	if ((uintptr_t) ptr != MAXALIGN(ptr))
+	{
+		Size	len = VARSIZE(value) - VARHDRSZ - sizeof(serial_header_t);
+		char   *copy = palloc(len);
+
+		memcpy(copy, ptr, len);
+		ptr = copy;
+	}
+
+	memset(eset, 0, sizeof(element_set_t));
+
+	eset->typlen = hdr.typlen;
+	eset->typalign = hdr.typalign;
+	eset->keykind = hdr.keykind;
+	eset->itemlen = hdr.itemlen;
+	eset->nall = hdr.nall;
+	eset->nsorted = hdr.nall;
+	eset->nbytes = (Size) hdr.nall * hdr.itemlen;
+	eset->data = ptr;
+
+	if (eset->typlen == -1)
+	{
+		eset->arena = ptr + eset->nbytes;
+		eset->arena_used = hdr.arena_used;
+		eset->arena_size = hdr.arena_used;
+	}
+}
+
+/*
+ * build a compacted set from elements of the array (in the current memory
+ * context), with the element type information cached in fn_extra
+ */
+static element_set_t *
+set_from_array(FunctionCallInfo fcinfo, ArrayType *input)
+{
+	element_info_t *info = (element_info_t *) fcinfo->flinfo->fn_extra;
+	element_set_t  *eset;
+
+	if ((info == NULL) || (info->element_type != ARR_ELEMTYPE(input)))
+	{
+		if (info == NULL)
+			info = (element_info_t *) MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+														 sizeof(element_info_t));
+
+		lookup_element_info(info, ARR_ELEMTYPE(input));
+
+		fcinfo->flinfo->fn_extra = info;
+	}
+
+	eset = init_set(info, CurrentMemoryContext, false);
+
+	add_elements(eset, input, ArrayGetNItems(ARR_NDIM(input), ARR_DIMS(input)));
+
+	/* empty (or all-NULL) arrays give an empty set, with nothing to compact */
+	if (eset->nall > 0)
+		compact_set(eset, false);
+
+	return eset;
+}
+
+/*
+ * copy the set into the current memory context (the set gets compacted, and
+ * the copy is sized exactly for the items, so that it can be resized later)
+ */
+static element_set_t *
+copy_set(element_set_t *eset)
+{
+	element_set_t *copy;
+	state_allocator_t *alloc = get_allocator(CurrentMemoryContext);
+
+	Size	alen = 0;
+
+	/* only copy the live items (and values), without any free space */
+	compact_set(eset, false);
+
+	copy = (element_set_t *) alloc_memory(alloc, sizeof(element_set_t));
+	copy->typlen = eset->typlen;
+	copy->typalign = eset->typalign;
+	copy->flags = (eset->flags & SET_COUNTED);
+	copy->argument = eset->argument;
+	copy->itemlen = eset->itemlen;
+	copy->keykind = eset->keykind;
+	copy->nsorted = eset->nall;
+	copy->nall = eset->nall;
+	copy->nbytes = (Size) eset->nall * eset->itemlen;
+	copy->alloc = alloc;
+
+	copy->data = alloc_memory(alloc, copy->nbytes);
+
+	copy->arena = NULL;
+	copy->ncompactions = eset->ncompactions;
+	copy->dedup_ratio = eset->dedup_ratio;
+
+	/* for varlena types, copy only values referenced by the items */
+	if (eset->typlen == -1)
+	{
+		alen = packed_arena_size(eset);
+		copy->arena = alloc_memory(alloc, alen);
+	}
+
+	copy->arena_used = alen;
+	copy->arena_size = alen;
+
+	pack_items(eset, copy->data, copy->arena);
+
+	STATS_ADD(bytes_copied, copy->nbytes + alen);
+	STATS_PEAK(copy);
+
+	return copy;
+}
 
-		/* If this is the first sorted part, we can just use it as the 'sorted' part. */
-		if (eset->nsorted == 0)
-			eset->nsorted = eset->nall;
+/* name of the key transformation (for count_distinct_state_info) */
+static const char *
+key_kind_name(char keykind)
+{
+	switch (keykind)
+	{
+		case KEY_BINARY:
+			return "binary";
+		case KEY_UNSIGNED:
+			return "unsigned";
+		case KEY_SIGNED:
+			return "signed";
+		case KEY_FLOAT:
+			return "float";
+		case KEY_VARLENA:
+			return "varlena";
+	}
 
-		/*
-		 * TODO Another optimization opportunity is that we don't really need to
-		 *		merge the arrays, if we freed enough space by processing the new
-		 *		items. We may postpone that until the last call (when finalizing
-		 *		the aggregate). OTOH if that happens, it shouldn't be that
-		 *		expensive to merge because the number of new items will be small
-		 *		(as we've removed a enough duplicities). But we still need to
-		 *		shuffle the data around, which wastes memory bandwidth.
-		 */
+	elog(ERROR, "unknown key kind '%c'", keykind);
+	return NULL;				/* keep compiler quiet */
+}
 
-		/* If a merge is needed, walk through the arrays and keep unique values. */
-		if (eset->nsorted < eset->nall)
-		{
-			MemoryContext oldctx = MemoryContextSwitchTo(eset->aggctx);
+/*
+ * add a variable-length value into the set
+ *
+ * The value is detoasted and copied into the arena (as uncompressed varlena
+ * with a 4B header), and a new item with the fingerprint is added to the
+ * unsorted part of the data array (which needs to have space for it).
+ */
+static void
+add_varlena(element_set_t *eset, Datum value)
+{
+	struct varlena *detoasted = PG_DETOAST_DATUM_PACKED(value);
 
-			/* allocate new array for the result */
-			char * data = palloc(eset->nbytes);
-			char * ptr = data;
+	add_varlena_bytes(eset, VARDATA_ANY(detoasted), VARSIZE_ANY_EXHDR(detoasted));
 
-			/* already sorted array */
-			char * a = eset->data;
-			char * a_max = eset->data + eset->nsorted * eset->typlen;
+	/* the detoasted copy is allocated in the aggregate context, so free it */
+	if ((Pointer) detoasted != DatumGetPointer(value))
+		pfree(detoasted);
+}
 
-			/* the new array */
-			char * b = eset->data + (eset->nsorted * eset->typlen);
-			char * b_max = eset->data + eset->nall * eset->typlen;
+/*
+ * add a variable-length value (the data without the varlena header) into
+ * the set - store it in the arena, and add an item referencing it
+ */
+static void
+add_varlena_bytes(element_set_t *eset, const char *ptr, Size len)
+{
+	varlena_item_t	item;
+	Size			offset;
 
-			MemoryContextSwitchTo(oldctx);
+	/* make sure there's enough space for the value in the arena */
+	offset = att_align_nominal(eset->arena_used, eset->typalign);
+	if (offset + VARHDRSZ + len > eset->arena_size)
+	{
+		reserve_arena(eset, VARHDRSZ + len);
+		offset = att_align_nominal(eset->arena_used, eset->typalign);
+	}
 
-			/*
-			 * TODO There's a possibility for optimization - if we get already
-			 *		sorted items (e.g. because of a subplan), we can just copy the
-			 *		arrays. The check is as simple as checking
-			 *
-			 *		(a_first > b_last) || (a_last < b_first).
-			 *
-			 *		OTOH this is probably very unlikely to happen in practice.
-			 */
+	Assert(offset + VARHDRSZ + len <= eset->arena_size);
 
-			while (true)
-			{
-				int r = memcmp(a, b, eset->typlen);
+	SET_VARSIZE(eset->arena + offset, VARHDRSZ + len);
+	memcpy(VARDATA(eset->arena + offset), ptr, len);
+	eset->arena_used = offset + VARHDRSZ + len;
 
-				/*
-				 * If both values are the same, copy one of them into the result and increment
-				 * both. Otherwise, increment only the smaller value.
-				 */
-				if (r == 0)
-				{
-					memcpy(ptr, a, eset->typlen);
-					a += eset->typlen;
-					b += eset->typlen;
-				}
-				else if (r < 0)
-				{
-					memcpy(ptr, a, eset->typlen);
-					a += eset->typlen;
-				}
-				else
-				{
-					memcpy(ptr, b, eset->typlen);
-					b += eset->typlen;
-				}
+	item.hash = hash_bytes_64((const unsigned char *) ptr, len);
+	item.offset = offset;
+	item.length = len;
 
-				ptr += eset->typlen;
+	memcpy(eset->data + ((Size) eset->itemlen * eset->nall), &item, sizeof(varlena_item_t));
+	eset->nall += 1;
+}
 
-				/*
-				 * If we reached the end of (at least) one of the arrays, copy all
-				 * the remaining items and we're done.
-				 */
-				if ((a == a_max) || (b == b_max))
-				{
-					if (a != a_max)		 /* b ended -> copy rest of a */
-					{
-						memcpy(ptr, a, a_max - a);
-						ptr += (a_max - a);
-					}
-					else if (b != b_max)	/* a ended -> copy rest of b */
-					{
-						memcpy(ptr, b, b_max - b);
-						ptr += (b_max - b);
-					}
-
-					break;
-				}
-			}
+/*
+ * make sure there's enough space for a new value of len bytes in the arena
+ *
+ * We first compact the items (to eliminate duplicate values), and then copy
+ * the remaining values into a new arena. The arena grows (twice the size)
+ * until at least ARRAY_FREE_FRACT of it is free after the copy.
+ */
+static void
+reserve_arena(element_set_t *eset, Size len)
+{
+	uint32	i;
+	Size	nbytes = eset->arena_size;
+	Size	used;
+	char   *arena;
+	Size	offset = 0;
 
-			Assert((ptr - data) <= (eset->nall * eset->typlen));
+	/* eliminate duplicate values (only when there are unsorted items) */
+	if (eset->nall > eset->nsorted)
+		compact_set(eset, false);
 
-			/*
-			 * Update the counts with the result of the merge (there might be
-			 * duplicities between the two parts, and we have eliminated them).
-			 */
-			eset->nsorted = (ptr - data) / eset->typlen;
-			eset->nall = eset->nsorted;
-			pfree(eset->data);
-			eset->data = data;
-		}
+	used = packed_arena_size(eset);
+
+	/* leave space for alignment padding of the new value */
+	while ((used + len + MAXIMUM_ALIGNOF) > nbytes * (1.0 - ARRAY_FREE_FRACT))
+		nbytes *= 2;
+
+	/* the arena is limited to MaxAllocSize (offsets are uint32) */
+	if (!AllocSizeIsValid(nbytes))
+		elog(ERROR, "invalid memory alloc request size %zu", nbytes);
+
+	TRACE_COUNT_DISTINCT_RESIZE_START(eset->arena_size, nbytes, 1);
+
+	arena = alloc_memory(eset->alloc, nbytes);
+
+	/* copy the live values in item order, and update the offsets */
+	for (i = 0; i < eset->nall; i++)
+	{
+		varlena_item_t *item = (varlena_item_t *) (eset->data + (Size) i * eset->itemlen);
+
+		offset = att_align_nominal(offset, eset->typalign);
+		memcpy(arena + offset, eset->arena + item->offset, VARHDRSZ + item->length);
+
+		item->offset = offset;
+		offset += VARHDRSZ + item->length;
 	}
 
-	Assert(eset->nall == eset->nsorted);
+	Assert(offset <= used);
 
-	/* compute free space as a fraction of the total size */
-	free_fract
-		= (eset->nbytes - eset->nall * eset->typlen) * 1.0 / eset->nbytes;
+	if (eset->flags & SET_ARENA_INLINE)
+		eset->flags &= ~SET_ARENA_INLINE;
+	else
+		free_memory(eset->alloc, eset->arena, eset->arena_size);
 
-	/*
-	 * If we need space for more items (e.g. not when finalizing the aggregate
-	 * result), enlarge the array when needed. We require ARRAY_FREE_FRACT of
-	 * the space to be free.
-	 */
-	if (need_space && (free_fract < ARRAY_FREE_FRACT))
+	eset->arena = arena;
+	eset->arena_size = nbytes;
+	eset->arena_used = offset;
+
+	TRACE_COUNT_DISTINCT_RESIZE_DONE(nbytes, 1);
+
+	STATS_ADD(reallocations, 1);
+	STATS_ADD(bytes_copied, offset);
+	STATS_PEAK(eset);
+}
+
+/*
+ * copy all values from the arena of src to the end of dst arena, and return
+ * the offset of the copied values in the dst arena (the arena is enlarged
+ * as needed)
+ */
+static Size
+append_arena(element_set_t *dst, element_set_t *src)
+{
+	Size	shift = MAXALIGN(dst->arena_used);
+
+	if (shift + src->arena_used > dst->arena_size)
 	{
-		/*
-		 * For small requests, we simply double the array size, because that's
-		 * what AllocSet will give use anyway. No point in trying to save
-		 * memory by growing the array slower.
-		 *
-		 * After reaching ALLOCSET_SEPARATE_THRESHOLD, the memory is allocated
-		 * in separate blocks, thus we can be smarter and grow the memory
-		 * a bit slower (just enough to get the 20% free space).
-		 *
-		 * XXX If the memory context uses smaller blocks, the switch to special
-		 * blocks may happen before ALLOCSET_SEPARATE_THRESHOLD. This limit
-		 * is simply global guarantee for all possible AllocSets.
-		 */
-		if ((eset->nbytes / 0.8) < ALLOCSET_SEPARATE_THRESHOLD)
-			eset->nbytes *= 2;
+		Size	nbytes = dst->arena_size;
+
+		while (shift + src->arena_used > nbytes)
+			nbytes *= 2;
+
+		/* the arena is limited to MaxAllocSize (offsets are uint32) */
+		if (!AllocSizeIsValid(nbytes))
+			elog(ERROR, "invalid memory alloc request size %zu", nbytes);
+
+		TRACE_COUNT_DISTINCT_RESIZE_START(dst->arena_size, nbytes, 1);
+
+		if (dst->flags & SET_ARENA_INLINE)
+		{
+			char   *arena = alloc_memory(dst->alloc, nbytes);
+
+			memcpy(arena, dst->arena, dst->arena_used);
+			dst->arena = arena;
+			dst->flags &= ~SET_ARENA_INLINE;
+		}
 		else
-			eset->nbytes /= 0.8;
+			dst->arena = realloc_memory(dst->alloc, dst->arena,
+										dst->arena_size, nbytes);
+
+		dst->arena_size = nbytes;
+
+		TRACE_COUNT_DISTINCT_RESIZE_DONE(nbytes, 1);
+
+		STATS_ADD(reallocations, 1);
+	}
+
+	memcpy(dst->arena + shift, src->arena, src->arena_used);
+	dst->arena_used = shift + src->arena_used;
+
+	STATS_ADD(bytes_copied, src->arena_used);
+
+	return shift;
+}
+
+/*
+ * copy the significant bytes of the value into the data array
+ *
+ * For values passed by value we can't use memcpy directly, as that assumes
+ * little endian behavior. store_att_byval does almost what we need, but it
+ * requires properly aligned buffer. We simply use a local Datum variable
+ * (which does guarante proper alignment), and then copy the value from it.
+ * The value is also transformed into a key, comparable as unsigned integer.
+ *
+ * Values passed by reference are simply copied inline (typlen bytes).
+ */
+static void
+copy_value(element_set_t *eset, char *dest, Datum value)
+{
+	if (SET_TYPBYVAL(eset))
+	{
+		Datum	tmp;
+
+		store_att_byval(&tmp, value, eset->typlen);
+		encode_key(eset->keykind, (char *) &tmp, eset->typlen);
+		memcpy(dest, &tmp, eset->typlen);
+	}
+	else
+		memcpy(dest, DatumGetPointer(value), eset->typlen);
+}
+
+/*
+ * decide how to transform values of the data type into keys
+ *
+ * For known data types passed by value we pick a transformation making the
+ * unsigned integer order of keys match the order of the data type. Unknown
+ * types passed by value are simply treated as unsigned integers.
+ */
+static char
+get_key_kind(Oid element_type, int16 typlen, bool typbyval)
+{
+	if (typlen == -1)
+		return KEY_VARLENA;
 
-		eset->data = repalloc(eset->data, eset->nbytes);
+	if (!typbyval)
+		return KEY_BINARY;
+
+	switch (element_type)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case DATEOID:
+		case TIMEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+		case CASHOID:
+			return KEY_SIGNED;
+
+		case FLOAT4OID:
+		case FLOAT8OID:
+			return KEY_FLOAT;
+
+		default:
+			return KEY_UNSIGNED;
 	}
+}
 
-#if DEBUG_PROFILE
-	elog(WARNING, "compact_set: bytes=%lu item=%d all=%d sorted=%d",
-				  eset->nbytes, eset->typlen, eset->nall, eset->nsorted);
+/* does the ordering of keys match the ordering of the data type? */
+static bool
+key_order_is_native(Oid element_type, char keykind)
+{
+	switch (keykind)
+	{
+		case KEY_SIGNED:
+		case KEY_FLOAT:
+			return true;
+
+		case KEY_UNSIGNED:
+			return (element_type == BOOLOID) ||
+				   (element_type == CHAROID) ||
+				   (element_type == OIDOID);
+
+		case KEY_BINARY:
+			/* types compared byte by byte (name is zero-padded) */
+			return (element_type == UUIDOID) ||
+				   (element_type == MACADDROID) ||
+#ifdef MACADDR8OID
+				   (element_type == MACADDR8OID) ||
 #endif
+				   (element_type == NAMEOID);
+
+		default:
+			return false;
+	}
 }
 
+/*
+ * sort the Datums using the default btree opclass of the type (and the
+ * collation of the aggregate), if there's one
+ */
 static void
-add_element(element_set_t *eset, char *value)
+sort_datums(Datum *datums, int ndatums, Oid element_type, Oid collation)
 {
-	/*
-	 * If there's not enough space for another item, perform compaction
-	 * (this also allocates enough free space for new entries).
-	 */
-	if (eset->typlen * (eset->nall + 1) > eset->nbytes)
-		compact_set(eset, true);
+	TypeCacheEntry	   *typentry;
+	SortSupportData		ssup;
 
-	/* there needs to be space for at least one more value (thanks to the compaction) */
-	Assert(eset->nbytes >= eset->typlen * (eset->nall + 1));
+	typentry = lookup_type_cache(element_type, TYPECACHE_LT_OPR);
 
-	/* now we're sure there's enough space */
-	memcpy(eset->data + (eset->typlen * eset->nall), value, eset->typlen);
-	eset->nall += 1;
+	/* no ordering for the type, keep the values in the current order */
+	if (!OidIsValid(typentry->lt_opr))
+		return;
+
+	memset(&ssup, 0, sizeof(SortSupportData));
+	ssup.ssup_cxt = CurrentMemoryContext;
+	ssup.ssup_collation = collation;
+	ssup.ssup_nulls_first = false;
+
+	PrepareSortSupportFromOrderingOp(typentry->lt_opr, &ssup);
+
+	qsort_arg(datums, ndatums, sizeof(Datum), compare_datums, &ssup);
 }
 
-/* XXX make sure the whole method is called within the aggregate context */
-static element_set_t *
-init_set(int16 typlen, bool typbyval, char typalign, MemoryContext ctx)
+static int
+compare_datums(const void *a, const void *b, void *arg)
 {
-	element_set_t * eset = (element_set_t *) palloc(sizeof(element_set_t));
+	return ApplySortComparator(*(Datum *) a, false, *(Datum *) b, false,
+							   (SortSupport) arg);
+}
 
-	eset->typlen = typlen;
-	eset->typbyval = typbyval;
-	eset->typalign = typalign;
-	eset->nsorted = 0;
-	eset->nall = 0;
-	eset->nbytes = ARRAY_INIT_SIZE;
-	eset->aggctx = ctx;
+#ifdef USE_SSE2_INTERSECT
+/* number of bits set in a 4-bit mask (of matching SIMD lanes) */
+static const uint8 popcount_4[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+#endif
 
-	eset->data = palloc(eset->nbytes);
+/*
+ * count items present in both (compacted) sets
+ */
+static uint32
+intersect_sets(element_set_t *eset1, element_set_t *eset2)
+{
+	Assert(!SET_IS_COUNTED(eset1) && !SET_IS_COUNTED(eset2));
+	Assert(eset1->nall == eset1->nsorted);
+	Assert(eset2->nall == eset2->nsorted);
 
-	return eset;
+	check_compatible(eset1, eset2);
+
+	/* make sure the first set is the smaller one */
+	if (eset1->nall > eset2->nall)
+	{
+		element_set_t *tmp = eset1;
+
+		eset1 = eset2;
+		eset2 = tmp;
+	}
+
+	if (eset1->nall == 0)
+		return 0;
+
+	if (eset1->typlen == -1)
+		return intersect_varlena(eset1, eset2);
+
+	if ((uint64) eset1->nall * GALLOP_RATIO < eset2->nall)
+		return intersect_gallop(eset1->data, eset1->nall,
+								eset2->data, eset2->nall,
+								eset1->typlen, SET_TYPBYVAL(eset1));
+
+	return intersect_sorted(eset1->data, eset1->nall, eset2->data, eset2->nall,
+							eset1->typlen, SET_TYPBYVAL(eset1));
 }
 
-static element_set_t *
-copy_set(element_set_t *eset)
+/*
+ * intersection of two sorted arrays of fixed-length items - a simple merge
+ * (inlined for the common lengths, just like merge_sorted)
+ */
+static inline uint32
+intersect_sorted_internal(const char *a, uint32 na, const char *b, uint32 nb,
+						  int16 typlen, bool byval)
 {
-	element_set_t *copy;
+	uint32	i = 0,
+			j = 0,
+			count = 0;
 
-	copy = (element_set_t *) palloc(sizeof(element_set_t));
-	copy->typlen = eset->typlen;
-	copy->typalign = eset->typalign;
-	copy->typbyval = eset->typbyval;
-	copy->nsorted = eset->nsorted;
-	copy->nall = eset->nall;
-	copy->nbytes = eset->nbytes;
+	while ((i < na) && (j < nb))
+	{
+		int		r = compare_keys(a + i * typlen, b + j * typlen, typlen, byval);
+
+		if (r == 0)
+		{
+			count++;
+			i++;
+			j++;
+		}
+		else if (r < 0)
+			i++;
+		else
+			j++;
+	}
 
-	copy->data = palloc(eset->nbytes);
+	return count;
+}
 
-	memcpy(copy->data, eset->data, eset->nbytes);
+static uint32
+intersect_sorted(const char *a, uint32 na, const char *b, uint32 nb,
+				 int16 typlen, bool byval)
+{
+	switch (typlen)
+	{
+		case 1:
+			return intersect_sorted_internal(a, na, b, nb, 1, byval);
+		case 2:
+			return intersect_sorted_internal(a, na, b, nb, 2, byval);
+		case 4:
+			if (byval)
+				return intersect_sorted_4(a, na, b, nb);
+			return intersect_sorted_internal(a, na, b, nb, 4, false);
+		case 8:
+			if (byval)
+				return intersect_sorted_8(a, na, b, nb);
+			return intersect_sorted_internal(a, na, b, nb, 8, false);
+		case 16:
+			return intersect_sorted_internal(a, na, b, nb, 16, false);
+		default:
+			return intersect_sorted_internal(a, na, b, nb, typlen, false);
+	}
+}
 
-	return copy;
+/*
+ * Intersection of sorted arrays of 4-byte keys. With SSE2 we compare blocks
+ * of 4 keys from each array (all 16 pairs, by rotating the second block),
+ * and then skip the block with the smaller last key (or both). Each key
+ * matches at most one key in the other array, so the matches are counted
+ * exactly once. The remaining keys are handled by the regular merge.
+ */
+static uint32
+intersect_sorted_4(const char *a, uint32 na, const char *b, uint32 nb)
+{
+	uint32	count = 0;
+
+#ifdef USE_SSE2_INTERSECT
+	uint32	i = 0,
+			j = 0;
+
+	while ((i + 4 <= na) && (j + 4 <= nb))
+	{
+		__m128i	va = _mm_loadu_si128((const __m128i *) (a + i * 4));
+		__m128i	vb = _mm_loadu_si128((const __m128i *) (b + j * 4));
+		__m128i	m;
+		uint32	amax,
+				bmax;
+
+		m = _mm_cmpeq_epi32(va, vb);
+		m = _mm_or_si128(m, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+		m = _mm_or_si128(m, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+		m = _mm_or_si128(m, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+
+		count += popcount_4[_mm_movemask_ps(_mm_castsi128_ps(m))];
+
+		memcpy(&amax, a + (i + 3) * 4, 4);
+		memcpy(&bmax, b + (j + 3) * 4, 4);
+
+		if (amax <= bmax)
+			i += 4;
+		if (bmax <= amax)
+			j += 4;
+	}
+
+	a += i * 4;
+	na -= i;
+	b += j * 4;
+	nb -= j;
+#endif
+
+	return count + intersect_sorted_internal(a, na, b, nb, 4, true);
+}
+
+/* the same for 8-byte keys, with blocks of 2 keys */
+static uint32
+intersect_sorted_8(const char *a, uint32 na, const char *b, uint32 nb)
+{
+	uint32	count = 0;
+
+#ifdef USE_SSE2_INTERSECT
+	uint32	i = 0,
+			j = 0;
+
+	while ((i + 2 <= na) && (j + 2 <= nb))
+	{
+		__m128i	va = _mm_loadu_si128((const __m128i *) (a + i * 8));
+		__m128i	vb = _mm_loadu_si128((const __m128i *) (b + j * 8));
+		__m128i	m1,
+				m2;
+		uint64	amax,
+				bmax;
+
+		/* SSE2 only compares 32-bit lanes, so combine the halves */
+		m1 = _mm_cmpeq_epi32(va, vb);
+		m1 = _mm_and_si128(m1, _mm_shuffle_epi32(m1, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		m2 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2)));
+		m2 = _mm_and_si128(m2, _mm_shuffle_epi32(m2, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		count += popcount_4[_mm_movemask_pd(_mm_castsi128_pd(_mm_or_si128(m1, m2)))];
+
+		memcpy(&amax, a + (i + 1) * 8, 8);
+		memcpy(&bmax, b + (j + 1) * 8, 8);
+
+		if (amax <= bmax)
+			i += 2;
+		if (bmax <= amax)
+			j += 2;
+	}
+
+	a += i * 8;
+	na -= i;
+	b += j * 8;
+	nb -= j;
+#endif
+
+	return count + intersect_sorted_internal(a, na, b, nb, 8, true);
+}
+
+/*
+ * Intersection of a small sorted array (a) with a much larger one (b). For
+ * each item of the small array we skip items of the large one with steps
+ * doubling in size, until we overshoot the item, and then we find the
+ * exact position using a binary search in the last step.
+ */
+static uint32
+intersect_gallop(const char *a, uint32 na, const char *b, uint32 nb,
+				 int16 typlen, bool byval)
+{
+	uint32	i;
+	uint64	lo = 0;
+	uint32	count = 0;
+
+	for (i = 0; (i < na) && (lo < nb); i++)
+	{
+		const char *key = a + i * typlen;
+		uint64	bound = 1;
+		uint64	hi;
+
+		/* all items before (lo + bound/2) are smaller than the key */
+		while ((lo + bound <= nb) &&
+			   (compare_keys(b + (lo + bound - 1) * typlen, key, typlen, byval) < 0))
+			bound *= 2;
+
+		hi = Min(lo + bound, nb);
+		lo = lo + bound / 2;
+
+		/* find the first item not smaller than the key */
+		while (lo < hi)
+		{
+			uint64	mid = lo + (hi - lo) / 2;
+
+			if (compare_keys(b + mid * typlen, key, typlen, byval) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if ((lo < nb) && (compare_keys(b + lo * typlen, key, typlen, byval) == 0))
+		{
+			count++;
+			lo++;
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Intersection of sets of varlena values - merge of the items, ordered by
+ * the fingerprint, length and value (each set has its own arena).
+ */
+static uint32
+intersect_varlena(element_set_t *eset1, element_set_t *eset2)
+{
+	uint32	i = 0,
+			j = 0,
+			count = 0;
+
+	while ((i < eset1->nall) && (j < eset2->nall))
+	{
+		varlena_item_t	a;
+		varlena_item_t	b;
+		int				r;
+
+		memcpy(&a, eset1->data + (Size) i * eset1->itemlen, sizeof(varlena_item_t));
+		memcpy(&b, eset2->data + (Size) j * eset2->itemlen, sizeof(varlena_item_t));
+
+		if (a.hash != b.hash)
+			r = (a.hash < b.hash) ? -1 : 1;
+		else if (a.length != b.length)
+			r = (a.length < b.length) ? -1 : 1;
+		else
+			r = memcmp(VARDATA(eset1->arena + a.offset),
+					   VARDATA(eset2->arena + b.offset), a.length);
+
+		if (r == 0)
+		{
+			count++;
+			i++;
+			j++;
+		}
+		else if (r < 0)
+			i++;
+		else
+			j++;
+	}
+
+	return count;
 }
 
-/* just compare the data directly using memcmp */
+/*
+ * compare pointers to items of a counted set - by count (descending), and
+ * then by key (arg is the element set)
+ */
 static int
-compare_items(const void *a, const void *b, void *size)
+compare_counted_items(const void *a, const void *b, void *arg)
 {
-	return memcmp(a, b, *(int *) size);
+	element_set_t  *eset = (element_set_t *) arg;
+	const char	   *ia = *(char * const *) a;
+	const char	   *ib = *(char * const *) b;
+	uint64			ca = get_item_count(eset, ia);
+	uint64			cb = get_item_count(eset, ib);
+
+	if (ca != cb)
+		return (ca > cb) ? -1 : 1;
+
+	return get_compare_func(eset)(ia, ib, eset);
 }
@@ -0,0 +1,1462 @@
+/*
+ * element_set.h - the sorted set used by count_distinct, and the kernels
+ *		working on it (comparators, deduplication, merging, keys)
+ *
+ * Copyright (C) Tomas Vondra, 2013 - 2016
+ *
+ * Nothing in this file calls into the server - it only needs the basic
+ * types and macros of c.h/postgres.h (Size, uint64, Assert, VARDATA,
+ * att_align_nominal, qsort_arg_comparator). So it can be compiled without
+ * a server, e.g. by the microbenchmarks in benchmark/kernels (which supply
+ * their own definitions of those), and the memory management, statistics
+ * and probes stay in count_distinct.c.
+ *
+ * The includer is expected to provide the definitions first. With
+ * USE_KERNEL_THREADS defined (and linked with -pthread), sorting and merging
+ * large batches of items may use multiple threads (see run_tasks).
+ */
+#ifndef ELEMENT_SET_H
+#define ELEMENT_SET_H
+
+#include <math.h>
+#include <string.h>
+
+#ifdef USE_KERNEL_THREADS
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+/* maximum number of threads executing the kernels (see run_tasks) */
+#define MAX_KERNEL_THREADS	64
+
+/*
+ * This count_distinct implementation uses a simple, partially sorted array.
+ *
+ * It's considerably simpler than the hash-table based version, and the main
+ * goals of this design is to:
+ *
+ * (a) minimize the palloc overhead - the whole array is allocated as a whole,
+ *	 and thus has a single palloc header (while in the hash table, each
+ *	 bucket had at least one such header)
+ *
+ * (b) optimal L2/L3 cache utilization - once the hash table can't fit into
+ *	 the CPU caches, it get's considerably slower because of cache misses,
+ *	 and it's impossible to improve the hash implementation (because for
+ *	 large hash tables it naturally leads to cache misses)
+ *
+ * Hash tables are great when you need to immediately query the structure
+ * (e.g. to immediately check whether the key is already in the table), but
+ * in count_distint it's not really necessary. We can accumulate some elements
+ * first (into a buffer), and then process all of them at once - this approach
+ * improves the CPU cache hit ratios. Also, the palloc overhead is much lower.
+ *
+ * The data array is split into three sections - sorted items, unsorted items,
+ * and unused.
+ *
+ *     ----------------------------------------------
+ *     |    sorted    |    unsorted    |    free    |
+ *     ----------------------------------------------
+ *
+ * Initially, the sorted / unsorted sections are empty, of course.
+ *
+ *     ----------------------------------------------
+ *     |                    free                    |
+ *     ----------------------------------------------
+ *
+ * New values are simply accumulated into the unsorted section, which grows.
+ *
+ *     ----------------------------------------------
+ *     |          unsorted  -->       |     free    |
+ *     ----------------------------------------------
+ *
+ * Once there's no more space for new items, the unsorted items are 'compacted'
+ * which means the values are sorted, duplicates are removed and the result
+ * is merged into the sorted section (unless it's empty). The 'merge' is just
+ * a simple 'merge-sort' of the two sorted inputs, with removal of duplicates.
+ *
+ * Once the compaction completes, it's checked whether enough space was freed,
+ * where 'enough' means ~20% of the array needs to be free. Using low values
+ * (e.g. space for at least one value) might cause 'oscillation' - imagine
+ * compaction that removes a single item, causing compaction on the very next
+ * addition. Using non-trivial threshold (like the 20%) should prevent such
+ * frequent compactions - which is quite expensive operation.
+ *
+ * If there's not enough free space, the array grows - twice the size when
+ * the compactions remove only a few duplicates (so that we don't keep
+ * merging the whole array for nothing), or just enough to get the free
+ * space when they remove many (see compact_set).
+ *
+ * Small sets (while using the initial array, allocated with the header) are
+ * handled a bit differently - new values are inserted directly into the
+ * sorted section, and duplicates are discarded right away. With only a few
+ * items the linear search is cheaper than sorting, and groups with just a
+ * couple of distinct values never need to be sorted at all.
+ *
+ * The compaction needs to be performed at the very end, when computing the
+ * actual result of the aggregate (distinct value in the array).
+ *
+ * Variable-length values (text, bytea, numeric, ...) can't be stored in the
+ * data array directly. Instead, the values are copied into a bump-pointer
+ * arena (a single chunk, so the values are referenced by offsets and it may
+ * be resized freely), and the data array stores fixed-length items with a
+ * 64-bit fingerprint (hash) of the value, and the offset/length of the value
+ * in the arena. The items are sorted by the fingerprint first, so the full
+ * values only need to be compared when the fingerprints match (which for
+ * distinct values is very unlikely). This means the sorted order is not
+ * related to the ordering of the data type, of course.
+ *
+ * Duplicate values are only removed from the arena when it runs out of space
+ * and gets repacked (copying only values referenced by the sorted items).
+ *
+ * Fixed-length values passed by value are stored as keys, transformed so
+ * that comparing them as unsigned integers matches the ordering of the data
+ * type (e.g. flipping the sign bit for signed integers). So for the common
+ * data types the sorted part is in the natural ascending order, and the
+ * array_agg_distinct result does not need to be sorted again. Values of
+ * other types (passed by reference or variable-length) are compared using
+ * memcmp or fingerprints, and the result is sorted using the default btree
+ * opclass of the type (unless memcmp matches the type ordering, e.g. uuid).
+ */
+typedef struct element_set_t
+{
+	/* allocator for the aggregation memory context (with memory accounting) */
+	struct state_allocator_t *alloc;
+
+	/*
+	 * The data array may get larger than MaxAllocSize (using huge allocations),
+	 * but the serialized state and the arena are limited to MaxAllocSize.
+	 */
+	Size	nbytes;		/* size of the data array (number of bytes) */
+	uint32	nsorted;	/* number of items in the sorted part */
+	uint32	nall;		/* number of all items (sorted + unsorted) */
+
+	/*
+	 * cache for get_typlenbyvalalign results (typbyval is not needed, as it
+	 * is determined by keykind - see SET_TYPBYVAL)
+	 */
+	int16	typlen;
+	char	typalign;
+
+	/* how the values are transformed into sortable keys (KEY_* values) */
+	char	keykind;
+
+	/*
+	 * size of an item in the data array - typlen for fixed-length types
+	 * (values passed by reference are stored inline), or the size of
+	 * varlena_item_t for variable-length ones (plus the count for counted
+	 * sets, see SET_COUNTED)
+	 */
+	int16	itemlen;
+
+	/*
+	 * which parts are allocated as part of the state chunk (SET_*_INLINE),
+	 * and whether the items are counted (SET_COUNTED)
+	 */
+	uint16	flags;
+
+	/* argument of the final function for counted sets (k or n) */
+	int32	argument;
+
+	/* arena with variable-length values (unused for fixed-length types) */
+	uint32	arena_used;	/* bytes used by values (incl. duplicates) */
+	uint32	arena_size;	/* size of the arena (number of bytes) */
+
+	/* number of compactions sorting new items (see state_info_t) */
+	uint32	ncompactions;
+
+	/* fraction of new items removed as duplicates (weighted average) */
+	float4	dedup_ratio;
+
+	char   *arena;
+
+	/* array of elements */
+	char   *data;		/* nsorted items first, then unsorted ones */
+} element_set_t;
+
+/*
+ * item representing a variable-length value, stored in the arena as a
+ * regular varlena (with 4B header, uncompressed and aligned to typalign)
+ */
+typedef struct varlena_item_t
+{
+	uint64	hash;		/* fingerprint of the value */
+	uint32	offset;		/* offset of the value in the arena */
+	uint32	length;		/* length of the value (without varlena header) */
+} varlena_item_t;
+
+/* parts of the state allocated together with the header (see init_set) */
+#define SET_DATA_INLINE		0x0001
+#define SET_ARENA_INLINE	0x0002
+
+/*
+ * Counted sets (multisets) track the number of occurrences of each value,
+ * stored as uint64 at the end of each item (after the key or varlena item).
+ * The items are still sorted and compared by the key only, and duplicates
+ * are eliminated by adding the counts together.
+ */
+#define SET_COUNTED			0x0004
+
+#define SET_IS_COUNTED(eset)	(((eset)->flags & SET_COUNTED) != 0)
+#define ITEM_COUNT(eset, item)	((item) + (eset)->itemlen - sizeof(uint64))
+
+/* only the transformed keys are passed by value */
+#define SET_TYPBYVAL(eset)	(((eset)->keykind == KEY_UNSIGNED) || \
+							 ((eset)->keykind == KEY_SIGNED) || \
+							 ((eset)->keykind == KEY_FLOAT))
+
+/*
+ * Transformations of values into keys. For values passed by value the keys
+ * are compared as unsigned integers (of typlen bytes), otherwise memcmp.
+ */
+#define KEY_BINARY			'b'		/* values passed by reference, as is */
+#define KEY_UNSIGNED		'u'		/* unsigned integers (oid, bool, ...) */
+#define KEY_SIGNED			's'		/* signed integers, sign bit flipped */
+#define KEY_FLOAT			'f'		/* floats, sign-magnitude to unsigned */
+#define KEY_VARLENA			'v'		/* varlena values, fingerprint order */
+
+/* compare keys of values passed by value as unsigned integers */
+static inline int
+compare_keys_1(const void *a, const void *b, void *arg)
+{
+	uint8	ka = *(const uint8 *) a;
+	uint8	kb = *(const uint8 *) b;
+
+	return (ka > kb) - (ka < kb);
+}
+
+static inline int
+compare_keys_2(const void *a, const void *b, void *arg)
+{
+	uint16	ka = *(const uint16 *) a;
+	uint16	kb = *(const uint16 *) b;
+
+	return (ka > kb) - (ka < kb);
+}
+
+static inline int
+compare_keys_4(const void *a, const void *b, void *arg)
+{
+	uint32	ka = *(const uint32 *) a;
+	uint32	kb = *(const uint32 *) b;
+
+	return (ka > kb) - (ka < kb);
+}
+
+static inline int
+compare_keys_8(const void *a, const void *b, void *arg)
+{
+	uint64	ka = *(const uint64 *) a;
+	uint64	kb = *(const uint64 *) b;
+
+	return (ka > kb) - (ka < kb);
+}
+
+/* just compare the data directly using memcmp (arg is the element set) */
+static inline int
+compare_items(const void *a, const void *b, void *arg)
+{
+	return memcmp(a, b, ((element_set_t *) arg)->typlen);
+}
+
+/* variants with constant length, so that memcmp gets inlined */
+static inline int
+compare_items_1(const void *a, const void *b, void *arg)
+{
+	return memcmp(a, b, 1);
+}
+
+static inline int
+compare_items_2(const void *a, const void *b, void *arg)
+{
+	return memcmp(a, b, 2);
+}
+
+static inline int
+compare_items_4(const void *a, const void *b, void *arg)
+{
+	return memcmp(a, b, 4);
+}
+
+static inline int
+compare_items_8(const void *a, const void *b, void *arg)
+{
+	return memcmp(a, b, 8);
+}
+
+static inline int
+compare_items_16(const void *a, const void *b, void *arg)
+{
+	return memcmp(a, b, 16);
+}
+
+/*
+ * compare varlena items - by fingerprint first, and only when it matches
+ * by length and the actual value in the arena (arg is the element set)
+ */
+static inline int
+compare_varlena_items(const void *a, const void *b, void *arg)
+{
+	const varlena_item_t *ia = (const varlena_item_t *) a;
+	const varlena_item_t *ib = (const varlena_item_t *) b;
+	element_set_t		 *eset = (element_set_t *) arg;
+
+	if (ia->hash != ib->hash)
+		return (ia->hash < ib->hash) ? -1 : 1;
+
+	if (ia->length != ib->length)
+		return (ia->length < ib->length) ? -1 : 1;
+
+	return memcmp(VARDATA(eset->arena + ia->offset),
+				  VARDATA(eset->arena + ib->offset), ia->length);
+}
+
+/* pick the comparator specialized for the item length (if there's one) */
+static inline qsort_arg_comparator
+get_compare_func(element_set_t *eset)
+{
+	if (eset->typlen == -1)
+		return compare_varlena_items;
+
+	/*
+	 * Keys of values passed by value are compared as unsigned integers. We
+	 * only compare the keys (typlen bytes), not the counts of counted sets.
+	 */
+	if (SET_TYPBYVAL(eset))
+	{
+		switch (eset->typlen)
+		{
+			case 1:
+				return compare_keys_1;
+			case 2:
+				return compare_keys_2;
+			case 4:
+				return compare_keys_4;
+			case 8:
+				return compare_keys_8;
+		}
+	}
+
+	switch (eset->typlen)
+	{
+		case 1:
+			return compare_items_1;
+		case 2:
+			return compare_items_2;
+		case 4:
+			return compare_items_4;
+		case 8:
+			return compare_items_8;
+		case 16:
+			return compare_items_16;
+		default:
+			return compare_items;
+	}
+}
+
+/* number of occurrences of the value of an item (in a counted set) */
+static inline uint64
+get_item_count(element_set_t *eset, const char *item)
+{
+	uint64	count;
+
+	memcpy(&count, ITEM_COUNT(eset, item), sizeof(uint64));
+
+	return count;
+}
+
+/* add the count of the src item to the dst item (in a counted set) */
+static inline void
+add_item_count(element_set_t *eset, char *dst, const char *src)
+{
+	uint64	count = get_item_count(eset, dst) + get_item_count(eset, src);
+
+	memcpy(ITEM_COUNT(eset, dst), &count, sizeof(uint64));
+}
+
+/*
+ * Merge two sorted arrays without duplicates into the output buffer, keeping
+ * only one copy of values present in both inputs. Returns pointer to the end
+ * of the merged data.
+ *
+ * The merge is inlined for the common item lengths, so that the compiler can
+ * replace the memcmp/memcpy calls with a couple of simple instructions.
+ * Keys of values passed by value are compared as unsigned integers.
+ */
+static inline int
+compare_keys(const char *a, const char *b, int16 typlen, bool byval)
+{
+	if (byval)
+	{
+		switch (typlen)
+		{
+			case 1:
+				return compare_keys_1(a, b, NULL);
+			case 2:
+				return compare_keys_2(a, b, NULL);
+			case 4:
+				return compare_keys_4(a, b, NULL);
+			case 8:
+				return compare_keys_8(a, b, NULL);
+		}
+	}
+
+	return memcmp(a, b, typlen);
+}
+
+static inline char *
+merge_sorted_internal(char *a, char *a_max, char *b, char *b_max,
+					  char *ptr, int16 typlen, bool byval)
+{
+	while ((a < a_max) && (b < b_max))
+	{
+		int r = compare_keys(a, b, typlen, byval);
+
+		/*
+		 * If both values are the same, copy one of them into the result and
+		 * increment both. Otherwise, increment only the smaller value.
+		 */
+		if (r == 0)
+		{
+			memcpy(ptr, a, typlen);
+			a += typlen;
+			b += typlen;
+		}
+		else if (r < 0)
+		{
+			memcpy(ptr, a, typlen);
+			a += typlen;
+		}
+		else
+		{
+			memcpy(ptr, b, typlen);
+			b += typlen;
+		}
+
+		ptr += typlen;
+	}
+
+	/* we reached the end of (at least) one of the arrays, copy the rest */
+	if (a < a_max)			/* b ended -> copy rest of a */
+	{
+		memcpy(ptr, a, a_max - a);
+		ptr += (a_max - a);
+	}
+	else if (b < b_max)		/* a ended -> copy rest of b */
+	{
+		memcpy(ptr, b, b_max - b);
+		ptr += (b_max - b);
+	}
+
+	return ptr;
+}
+
+static inline char *
+merge_sorted(char *a, char *a_max, char *b, char *b_max, char *out,
+			 int16 typlen, bool byval)
+{
+	switch (typlen)
+	{
+		case 1:
+			return merge_sorted_internal(a, a_max, b, b_max, out, 1, byval);
+		case 2:
+			return merge_sorted_internal(a, a_max, b, b_max, out, 2, byval);
+		case 4:
+			if (byval)
+				return merge_sorted_internal(a, a_max, b, b_max, out, 4, true);
+			return merge_sorted_internal(a, a_max, b, b_max, out, 4, false);
+		case 8:
+			if (byval)
+				return merge_sorted_internal(a, a_max, b, b_max, out, 8, true);
+			return merge_sorted_internal(a, a_max, b, b_max, out, 8, false);
+		case 16:
+			return merge_sorted_internal(a, a_max, b, b_max, out, 16, false);
+		default:
+			return merge_sorted_internal(a, a_max, b, b_max, out, typlen, false);
+	}
+}
+
+/*
+ * Merge two sorted arrays of varlena items, with values in the arena of the
+ * set. The values referenced by items from the second array are shifted by
+ * b_shift bytes (when the arena was appended from a different set).
+ */
+static inline char *
+merge_sorted_varlena(element_set_t *eset, char *a, char *a_max,
+					 char *b, char *b_max, char *ptr, Size b_shift)
+{
+	varlena_item_t	item;
+
+	while ((a < a_max) && (b < b_max))
+	{
+		int		r;
+
+		memcpy(&item, b, sizeof(varlena_item_t));
+		item.offset += b_shift;
+
+		r = compare_varlena_items(a, &item, eset);
+
+		if (r == 0)
+		{
+			memcpy(ptr, a, sizeof(varlena_item_t));
+			a += sizeof(varlena_item_t);
+			b += sizeof(varlena_item_t);
+		}
+		else if (r < 0)
+		{
+			memcpy(ptr, a, sizeof(varlena_item_t));
+			a += sizeof(varlena_item_t);
+		}
+		else
+		{
+			memcpy(ptr, &item, sizeof(varlena_item_t));
+			b += sizeof(varlena_item_t);
+		}
+
+		ptr += sizeof(varlena_item_t);
+	}
+
+	if (a < a_max)
+	{
+		memcpy(ptr, a, a_max - a);
+		ptr += (a_max - a);
+	}
+
+	/* items from the second array need to be shifted, so copy one by one */
+	while (b < b_max)
+	{
+		memcpy(&item, b, sizeof(varlena_item_t));
+		item.offset += b_shift;
+
+		memcpy(ptr, &item, sizeof(varlena_item_t));
+
+		b += sizeof(varlena_item_t);
+		ptr += sizeof(varlena_item_t);
+	}
+
+	return ptr;
+}
+
+/*
+ * Merge two sorted arrays of counted items - the same as merge_sorted (or
+ * merge_sorted_varlena, with the same meaning of b_shift), except that for
+ * items present in both arrays we add the counts together.
+ */
+static inline char *
+merge_sorted_counted(element_set_t *eset, char *a, char *a_max,
+					 char *b, char *b_max, char *ptr, Size b_shift)
+{
+	qsort_arg_comparator	cmp = get_compare_func(eset);
+	int16	itemlen = eset->itemlen;
+	varlena_item_t	item;
+
+	while ((a < a_max) && (b < b_max))
+	{
+		int		r;
+
+		/* copy the item from the second array, shifting the value offset */
+		memcpy(ptr, b, itemlen);
+
+		if (eset->typlen == -1)
+		{
+			memcpy(&item, b, sizeof(varlena_item_t));
+			item.offset += b_shift;
+			memcpy(ptr, &item, sizeof(varlena_item_t));
+		}
+
+		r = cmp(a, ptr, eset);
+
+		if (r == 0)
+		{
+			memcpy(ptr, a, itemlen);
+			add_item_count(eset, ptr, b);
+			a += itemlen;
+			b += itemlen;
+		}
+		else if (r < 0)
+		{
+			memcpy(ptr, a, itemlen);
+			a += itemlen;
+		}
+		else
+			b += itemlen;
+
+		ptr += itemlen;
+	}
+
+	if (a < a_max)
+	{
+		memcpy(ptr, a, a_max - a);
+		ptr += (a_max - a);
+	}
+
+	while (b < b_max)
+	{
+		memcpy(ptr, b, itemlen);
+
+		if (eset->typlen == -1)
+		{
+			memcpy(&item, b, sizeof(varlena_item_t));
+			item.offset += b_shift;
+			memcpy(ptr, &item, sizeof(varlena_item_t));
+		}
+
+		b += itemlen;
+		ptr += itemlen;
+	}
+
+	return ptr;
+}
+
+/*
+ * Remove duplicate values from the sorted array. That is - walk through
+ * the array, compare each item with the preceding one, and only keep it
+ * if they differ. We skip the first value, as it's always unique (there
+ * is no preceding value it might be equal to).
+ *
+ * Returns number of unique items.
+ */
+static inline uint32
+dedup_sorted(element_set_t *eset, char *base, uint32 nitems)
+{
+	uint32	i;
+	uint32	cnt = 1;
+	char   *last = base;
+	char   *curr;
+
+	for (i = 1; i < nitems; i++)
+	{
+		curr = base + ((Size) i * eset->itemlen);
+
+		/* items differ (keep the item) */
+		if ((eset->typlen == -1) ?
+			(compare_varlena_items(last, curr, eset) != 0) :
+			(memcmp(last, curr, eset->typlen) != 0))
+		{
+			last += eset->itemlen;
+			cnt  += 1;
+
+			/* only copy if really needed */
+			if (last != curr)
+				memcpy(last, curr, eset->itemlen);
+		}
+		else if (SET_IS_COUNTED(eset))
+			add_item_count(eset, last, curr);
+	}
+
+	return cnt;
+}
+
+/*
+ * transform the value (typlen bytes in native byte order) into a key
+ *
+ * Signed integers get the sign bit flipped. Floats are normalized first, so
+ * that -0.0 and 0.0 (and all NaNs) are the same key, and then the negative
+ * values get all bits flipped (to reverse the order), while positive ones
+ * get the sign bit set (to sort after negative values).
+ */
+static inline void
+encode_key(char keykind, char *key, int16 typlen)
+{
+	if (keykind == KEY_SIGNED)
+	{
+		switch (typlen)
+		{
+			case 1:
+				*(uint8 *) key ^= (uint8) 0x80;
+				break;
+			case 2:
+				*(uint16 *) key ^= (uint16) 0x8000;
+				break;
+			case 4:
+				*(uint32 *) key ^= (uint32) 0x80000000;
+				break;
+			case 8:
+				*(uint64 *) key ^= UINT64CONST(0x8000000000000000);
+				break;
+		}
+	}
+	else if ((keykind == KEY_FLOAT) && (typlen == 4))
+	{
+		float4	f = *(float4 *) key;
+		uint32	u;
+
+		if (isnan(f))
+			f = (float4) NAN;
+		else if (f == 0)
+			f = 0;
+
+		memcpy(&u, &f, sizeof(uint32));
+
+		if (u & 0x80000000)
+			u = ~u;
+		else
+			u |= 0x80000000;
+
+		*(uint32 *) key = u;
+	}
+	else if ((keykind == KEY_FLOAT) && (typlen == 8))
+	{
+		float8	f = *(float8 *) key;
+		uint64	u;
+
+		if (isnan(f))
+			f = (float8) NAN;
+		else if (f == 0)
+			f = 0;
+
+		memcpy(&u, &f, sizeof(uint64));
+
+		if (u & UINT64CONST(0x8000000000000000))
+			u = ~u;
+		else
+			u |= UINT64CONST(0x8000000000000000);
+
+		*(uint64 *) key = u;
+	}
+}
+
+/* inverse of encode_key (except for the float normalization, of course) */
+static inline void
+decode_key(char keykind, char *key, int16 typlen)
+{
+	if (keykind == KEY_SIGNED)
+		encode_key(keykind, key, typlen);
+	else if ((keykind == KEY_FLOAT) && (typlen == 4))
+	{
+		uint32	u = *(uint32 *) key;
+
+		if (u & 0x80000000)
+			u &= ~((uint32) 0x80000000);
+		else
+			u = ~u;
+
+		*(uint32 *) key = u;
+	}
+	else if ((keykind == KEY_FLOAT) && (typlen == 8))
+	{
+		uint64	u = *(uint64 *) key;
+
+		if (u & UINT64CONST(0x8000000000000000))
+			u &= ~UINT64CONST(0x8000000000000000);
+		else
+			u = ~u;
+
+		*(uint64 *) key = u;
+	}
+}
+
+/*
+ * 64-bit fingerprint of the value (MurmurHash64A)
+ *
+ * It's only used to speed up comparisons of variable-length values, so the
+ * hash does not need to be stable across platforms.
+ */
+static inline uint64
+hash_bytes_64(const unsigned char *data, Size len)
+{
+	const uint64	m = UINT64CONST(0xc6a4a7935bd1e995);
+	const int		r = 47;
+	uint64			h = UINT64CONST(0x8445d61a4e774912) ^ (len * m);
+
+	while (len >= 8)
+	{
+		uint64	k;
+
+		memcpy(&k, data, sizeof(uint64));
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		h ^= k;
+		h *= m;
+
+		data += 8;
+		len -= 8;
+	}
+
+	switch (len)
+	{
+		case 7:
+			h ^= (uint64) data[6] << 48;
+			/* FALLTHROUGH */
+		case 6:
+			h ^= (uint64) data[5] << 40;
+			/* FALLTHROUGH */
+		case 5:
+			h ^= (uint64) data[4] << 32;
+			/* FALLTHROUGH */
+		case 4:
+			h ^= (uint64) data[3] << 24;
+			/* FALLTHROUGH */
+		case 3:
+			h ^= (uint64) data[2] << 16;
+			/* FALLTHROUGH */
+		case 2:
+			h ^= (uint64) data[1] << 8;
+			/* FALLTHROUGH */
+		case 1:
+			h ^= (uint64) data[0];
+			h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+}
+
+/* size of the arena with only values referenced by items (no duplicates) */
+static inline Size
+packed_arena_size(element_set_t *eset)
+{
+	uint32	i;
+	Size	len = 0;
+
+	for (i = 0; i < eset->nall; i++)
+	{
+		varlena_item_t *item = (varlena_item_t *) (eset->data + (Size) i * eset->itemlen);
+
+		len = att_align_nominal(len, eset->typalign) + VARHDRSZ + item->length;
+	}
+
+	return len;
+}
+
+/*
+ * merge two sorted arrays of items of the set (picking the merge variant for
+ * the kind of items), see merge_sorted_varlena for the meaning of b_shift
+ */
+static inline char *
+merge_items(element_set_t *eset, char *a, char *a_max, char *b, char *b_max,
+			char *out, Size b_shift)
+{
+	if (SET_IS_COUNTED(eset))
+		return merge_sorted_counted(eset, a, a_max, b, b_max, out, b_shift);
+	else if (eset->typlen == -1)
+		return merge_sorted_varlena(eset, a, a_max, b, b_max, out, b_shift);
+
+	Assert(b_shift == 0);
+
+	return merge_sorted(a, a_max, b, b_max, out, eset->itemlen,
+						SET_TYPBYVAL(eset));
+}
+
+/*
+ * Merge two sorted arrays from the end, writing the merged items backwards
+ * from out (the end of the output), and return pointer to the first merged
+ * item. Otherwise the same as merge_sorted.
+ *
+ * This allows merging in place, when the output ends behind the first array
+ * (starting at the same address) with enough space for both arrays - the
+ * write position can't get ahead of the remaining items of the first array,
+ * as there's still space for all remaining items of the second one. When
+ * there are no more items in the second array, the rest of the first one
+ * only needs to be moved if some duplicates were eliminated.
+ */
+static inline char *
+merge_sorted_backward_internal(char *a, char *a_max, char *b, char *b_max,
+							   char *out, int16 typlen, bool byval)
+{
+	while ((a < a_max) && (b < b_max))
+	{
+		int r = compare_keys(a_max - typlen, b_max - typlen, typlen, byval);
+
+		out -= typlen;
+
+		/* the larger value goes first, for equal values keep only one */
+		if (r == 0)
+		{
+			memcpy(out, a_max - typlen, typlen);
+			a_max -= typlen;
+			b_max -= typlen;
+		}
+		else if (r > 0)
+		{
+			memcpy(out, a_max - typlen, typlen);
+			a_max -= typlen;
+		}
+		else
+		{
+			memcpy(out, b_max - typlen, typlen);
+			b_max -= typlen;
+		}
+	}
+
+	if (b < b_max)
+	{
+		out -= (b_max - b);
+		memcpy(out, b, b_max - b);
+	}
+	else if (a < a_max)
+	{
+		out -= (a_max - a);
+		if (out != a)
+			memmove(out, a, a_max - a);
+	}
+
+	return out;
+}
+
+static inline char *
+merge_sorted_backward(char *a, char *a_max, char *b, char *b_max, char *out,
+					  int16 typlen, bool byval)
+{
+	switch (typlen)
+	{
+		case 1:
+			return merge_sorted_backward_internal(a, a_max, b, b_max, out, 1, byval);
+		case 2:
+			return merge_sorted_backward_internal(a, a_max, b, b_max, out, 2, byval);
+		case 4:
+			if (byval)
+				return merge_sorted_backward_internal(a, a_max, b, b_max, out, 4, true);
+			return merge_sorted_backward_internal(a, a_max, b, b_max, out, 4, false);
+		case 8:
+			if (byval)
+				return merge_sorted_backward_internal(a, a_max, b, b_max, out, 8, true);
+			return merge_sorted_backward_internal(a, a_max, b, b_max, out, 8, false);
+		case 16:
+			return merge_sorted_backward_internal(a, a_max, b, b_max, out, 16, false);
+		default:
+			return merge_sorted_backward_internal(a, a_max, b, b_max, out, typlen, false);
+	}
+}
+
+/*
+ * backward merge of varlena and counted items (with the same meaning of
+ * b_shift as in merge_sorted_varlena, and counts added for items present
+ * in both arrays as in merge_sorted_counted)
+ */
+static inline char *
+merge_sorted_backward_generic(element_set_t *eset, char *a, char *a_max,
+							  char *b, char *b_max, char *out, Size b_shift)
+{
+	qsort_arg_comparator	cmp = get_compare_func(eset);
+	int16	itemlen = eset->itemlen;
+	varlena_item_t	item;
+
+	while ((a < a_max) && (b < b_max))
+	{
+		char   *pa = a_max - itemlen;
+		char   *pb = b_max - itemlen;
+		int		r;
+
+		out -= itemlen;
+
+		/*
+		 * copy the item from the second array, shifting the value offset (the
+		 * slot is behind the remaining items of the first array)
+		 */
+		memcpy(out, pb, itemlen);
+
+		if (eset->typlen == -1)
+		{
+			memcpy(&item, pb, sizeof(varlena_item_t));
+			item.offset += b_shift;
+			memcpy(out, &item, sizeof(varlena_item_t));
+		}
+
+		r = cmp(pa, out, eset);
+
+		if (r == 0)
+		{
+			memcpy(out, pa, itemlen);
+			if (SET_IS_COUNTED(eset))
+				add_item_count(eset, out, pb);
+			a_max = pa;
+			b_max = pb;
+		}
+		else if (r > 0)
+		{
+			memcpy(out, pa, itemlen);
+			a_max = pa;
+		}
+		else
+			b_max = pb;
+	}
+
+	while (b < b_max)
+	{
+		b_max -= itemlen;
+		out -= itemlen;
+
+		memcpy(out, b_max, itemlen);
+
+		if (eset->typlen == -1)
+		{
+			memcpy(&item, b_max, sizeof(varlena_item_t));
+			item.offset += b_shift;
+			memcpy(out, &item, sizeof(varlena_item_t));
+		}
+	}
+
+	if (a < a_max)
+	{
+		out -= (a_max - a);
+		if (out != a)
+			memmove(out, a, a_max - a);
+	}
+
+	return out;
+}
+
+/*
+ * merge two sorted arrays of items of the set from the end (see
+ * merge_sorted_backward), picking the variant for the kind of items
+ */
+static inline char *
+merge_items_backward(element_set_t *eset, char *a, char *a_max,
+					 char *b, char *b_max, char *out, Size b_shift)
+{
+	if (SET_IS_COUNTED(eset) || (eset->typlen == -1))
+		return merge_sorted_backward_generic(eset, a, a_max, b, b_max, out,
+											 b_shift);
+
+	Assert(b_shift == 0);
+
+	return merge_sorted_backward(a, a_max, b, b_max, out, eset->itemlen,
+								 SET_TYPBYVAL(eset));
+}
+
+/*
+ * 64-bit prefix of the key of an item, preserving the order of the items
+ * (when an item sorts before another one, its prefix is not greater) - the
+ * fingerprint for varlena items, the key shifted to the top bits for keys
+ * compared as unsigned integers, and the first 8 bytes as a big-endian
+ * integer for keys compared by memcmp
+ */
+static inline uint64
+item_prefix(element_set_t *eset, const char *item)
+{
+	uint64	prefix = 0;
+	int		i;
+
+	if (eset->typlen == -1)
+	{
+		memcpy(&prefix, item, sizeof(uint64));
+		return prefix;
+	}
+
+	if (SET_TYPBYVAL(eset))
+	{
+		switch (eset->typlen)
+		{
+			case 1:
+				return (uint64) *(const uint8 *) item << 56;
+			case 2:
+				return (uint64) *(const uint16 *) item << 48;
+			case 4:
+				return (uint64) *(const uint32 *) item << 32;
+			case 8:
+				return *(const uint64 *) item;
+		}
+	}
+
+	for (i = 0; i < Min(eset->typlen, 8); i++)
+		prefix |= (uint64) (unsigned char) item[i] << (56 - 8 * i);
+
+	return prefix;
+}
+
+/*
+ * Reorder the items in place, so that they are grouped into 2^nbits
+ * partitions by the top nbits bits of the prefix (a single MSD radix pass,
+ * as in the American flag sort). Each partition is a range of keys, so
+ * after sorting the partitions one by one the whole array is sorted.
+ *
+ * The leading bits shared by the prefixes of all the items are skipped
+ * (e.g. the top bits of small integers are all the same), otherwise the
+ * items would often end up in a single partition.
+ *
+ * The index of the first item of partition i is stored in bounds[i], and
+ * bounds[2^nbits] is the number of items. The next array (2^nbits entries)
+ * is used to track the placed items, tmp needs to have space for an item.
+ */
+static inline void
+partition_items(element_set_t *eset, char *base, uint32 nitems, int nbits,
+				uint32 *bounds, uint32 *next, char *tmp)
+{
+	int		nparts = (1 << nbits);
+	int		shift;
+	uint64	mask = (nparts - 1);
+	uint64	first = item_prefix(eset, base);
+	uint64	diff = 0;
+	int16	itemlen = eset->itemlen;
+	uint32	i;
+	int		p;
+
+	Assert((nbits > 0) && (nbits < 32));
+
+	/* bits where the prefixes differ, partition by the top nbits of those */
+	for (i = 1; i < nitems; i++)
+		diff |= (item_prefix(eset, base + (Size) i * itemlen) ^ first);
+
+	for (shift = 64 - nbits; shift > 0; shift--)
+		if ((diff >> (shift + nbits - 1)) != 0)
+			break;
+
+	/* count the items in each partition */
+	memset(bounds, 0, (nparts + 1) * sizeof(uint32));
+
+	for (i = 0; i < nitems; i++)
+		bounds[((item_prefix(eset, base + (Size) i * itemlen) >> shift) & mask) + 1] += 1;
+
+	for (p = 0; p < nparts; p++)
+	{
+		bounds[p + 1] += bounds[p];
+		next[p] = bounds[p];
+	}
+
+	/*
+	 * Walk the partitions, and move the misplaced items into the partitions
+	 * they belong to (the displaced item is moved the same way, until we get
+	 * an item belonging to the current partition).
+	 */
+	for (p = 0; p < nparts; p++)
+	{
+		while (next[p] < bounds[p + 1])
+		{
+			char   *item = base + (Size) next[p] * itemlen;
+			int		dest = ((item_prefix(eset, item) >> shift) & mask);
+
+			if (dest == p)
+			{
+				next[p] += 1;
+				continue;
+			}
+
+			memcpy(tmp, item, itemlen);
+
+			while (dest != p)
+			{
+				char   *slot = base + (Size) next[dest] * itemlen;
+
+				next[dest] += 1;
+
+				/* swap the carried item with the one in the slot */
+				memcpy(item, slot, itemlen);
+				memcpy(slot, tmp, itemlen);
+				memcpy(tmp, item, itemlen);
+
+				dest = ((item_prefix(eset, tmp) >> shift) & mask);
+			}
+
+			memcpy(item, tmp, itemlen);
+			next[p] += 1;
+		}
+	}
+}
+
+/*
+ * Tasks executed by a group of threads (when built with USE_KERNEL_THREADS).
+ *
+ * The threads only ever run the kernels above on memory allocated by the
+ * caller - no allocations, no errors, nothing that might call into the
+ * server (which is not thread-safe). The threads are started for a single
+ * run_tasks call and joined before it returns, with all signals blocked so
+ * that they're still delivered to the calling thread. The calling thread
+ * executes tasks too, and when a thread can't be started the remaining
+ * threads simply execute more tasks.
+ */
+typedef void (*task_func_t) (void *arg, uint32 task);
+
+typedef struct task_group_t
+{
+	task_func_t	func;
+	void	   *arg;
+	uint32		ntasks;
+#ifdef USE_KERNEL_THREADS
+	pthread_mutex_t	lock;
+#endif
+	uint32		next;		/* next task to execute */
+} task_group_t;
+
+/* execute tasks of the group until there are none left */
+static inline void
+execute_tasks(task_group_t *group)
+{
+	while (true)
+	{
+		uint32	task;
+
+#ifdef USE_KERNEL_THREADS
+		pthread_mutex_lock(&group->lock);
+		task = group->next++;
+		pthread_mutex_unlock(&group->lock);
+#else
+		task = group->next++;
+#endif
+
+		if (task >= group->ntasks)
+			break;
+
+		group->func(group->arg, task);
+	}
+}
+
+#ifdef USE_KERNEL_THREADS
+static inline void *
+task_thread_main(void *arg)
+{
+	execute_tasks((task_group_t *) arg);
+
+	return NULL;
+}
+#endif
+
+/* execute tasks 0 .. ntasks-1 using up to nthreads threads (the caller included) */
+static inline void
+run_tasks(task_func_t func, void *arg, uint32 ntasks, int nthreads)
+{
+	task_group_t	group;
+
+	group.func = func;
+	group.arg = arg;
+	group.ntasks = ntasks;
+	group.next = 0;
+
+#ifdef USE_KERNEL_THREADS
+	if ((nthreads > 1) && (ntasks > 1))
+	{
+		pthread_t	threads[MAX_KERNEL_THREADS];
+		sigset_t	blocked;
+		sigset_t	oldmask;
+		int			nstarted = 0;
+		int			i;
+
+		pthread_mutex_init(&group.lock, NULL);
+
+		/* the threads inherit the signal mask */
+		sigfillset(&blocked);
+		pthread_sigmask(SIG_SETMASK, &blocked, &oldmask);
+
+		for (i = 1; i < Min(Min(nthreads, MAX_KERNEL_THREADS), ntasks); i++)
+		{
+			if (pthread_create(&threads[nstarted], NULL, task_thread_main, &group) != 0)
+				break;
+
+			nstarted++;
+		}
+
+		pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+		execute_tasks(&group);
+
+		for (i = 0; i < nstarted; i++)
+			pthread_join(threads[i], NULL);
+
+		pthread_mutex_destroy(&group.lock);
+
+		return;
+	}
+#endif
+
+	execute_tasks(&group);
+}
+
+/* sort the partitions (see partition_items) one by one, as tasks */
+typedef struct sort_partitions_t
+{
+	element_set_t  *eset;
+	char		   *base;
+	uint32		   *bounds;
+} sort_partitions_t;
+
+static inline void
+sort_partition_task(void *arg, uint32 task)
+{
+	sort_partitions_t  *sort = (sort_partitions_t *) arg;
+	element_set_t	   *eset = sort->eset;
+	uint32				nitems = sort->bounds[task + 1] - sort->bounds[task];
+
+	if (nitems > 1)
+		qsort_arg(sort->base + (Size) sort->bounds[task] * eset->itemlen,
+				  nitems, eset->itemlen, get_compare_func(eset), eset);
+}
+
+/*
+ * sort the partitions of items (with bounds as computed by partition_items)
+ * using up to nthreads threads
+ */
+static inline void
+sort_partitions(element_set_t *eset, char *base, uint32 *bounds, int nparts,
+				int nthreads)
+{
+	sort_partitions_t	sort;
+
+	sort.eset = eset;
+	sort.base = base;
+	sort.bounds = bounds;
+
+	run_tasks(sort_partition_task, &sort, nparts, nthreads);
+}
+
+/* index of the first of the sorted items not less than the item */
+static inline uint32
+items_lower_bound(element_set_t *eset, char *base, uint32 nitems, char *item)
+{
+	qsort_arg_comparator	cmp = get_compare_func(eset);
+	uint32	lo = 0,
+			hi = nitems;
+
+	while (lo < hi)
+	{
+		uint32	mid = lo + (hi - lo) / 2;
+
+		if (cmp(base + (Size) mid * eset->itemlen, item, eset) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* merge the chunks of two sorted arrays, as tasks */
+typedef struct merge_chunks_t
+{
+	element_set_t  *eset;
+	char		   *a;
+	char		   *b;
+	char		   *out;
+	uint32		   *a_bounds;	/* first item of the chunks in a */
+	uint32		   *b_bounds;	/* first item of the chunks in b */
+	uint32		   *nmerged;	/* number of items of the merged chunks */
+} merge_chunks_t;
+
+static inline void
+merge_chunk_task(void *arg, uint32 task)
+{
+	merge_chunks_t *merge = (merge_chunks_t *) arg;
+	int16			itemlen = merge->eset->itemlen;
+	char		   *out = merge->out +
+		(Size) (merge->a_bounds[task] + merge->b_bounds[task]) * itemlen;
+	char		   *end;
+
+	end = merge_items(merge->eset,
+					  merge->a + (Size) merge->a_bounds[task] * itemlen,
+					  merge->a + (Size) merge->a_bounds[task + 1] * itemlen,
+					  merge->b + (Size) merge->b_bounds[task] * itemlen,
+					  merge->b + (Size) merge->b_bounds[task + 1] * itemlen,
+					  out, 0);
+
+	merge->nmerged[task] = (end - out) / itemlen;
+}
+
+/*
+ * Merge two sorted arrays of items (na and nb items) just like merge_items,
+ * but in nchunks independent chunks, using up to nthreads threads.
+ *
+ * The larger array is split into chunks with the same number of items, and
+ * the other one at the first item not less than the first item of each
+ * chunk, so that equal items always end up in the same chunk. Each chunk
+ * is merged into the output at the position it would have without any
+ * duplicates (so the chunks can't overlap), and the merged chunks are then
+ * moved together. The bounds need space for 3 * (nchunks + 1) values.
+ *
+ * Returns the end of the merged items, just like merge_items.
+ */
+static inline char *
+merge_items_parallel(element_set_t *eset, char *a, uint32 na, char *b, uint32 nb,
+					 char *out, uint32 nchunks, int nthreads, uint32 *bounds)
+{
+	merge_chunks_t	merge;
+	char   *ptr = out;
+	uint32	i;
+
+	merge.eset = eset;
+	merge.a = a;
+	merge.b = b;
+	merge.out = out;
+	merge.a_bounds = bounds;
+	merge.b_bounds = bounds + (nchunks + 1);
+	merge.nmerged = bounds + 2 * (nchunks + 1);
+
+	for (i = 0; i < nchunks; i++)
+	{
+		if (na >= nb)
+		{
+			merge.a_bounds[i] = (uint32) ((uint64) na * i / nchunks);
+			merge.b_bounds[i] = (i == 0) ? 0 :
+				items_lower_bound(eset, b, nb,
+								  a + (Size) merge.a_bounds[i] * eset->itemlen);
+		}
+		else
+		{
+			merge.b_bounds[i] = (uint32) ((uint64) nb * i / nchunks);
+			merge.a_bounds[i] = (i == 0) ? 0 :
+				items_lower_bound(eset, a, na,
+								  b + (Size) merge.b_bounds[i] * eset->itemlen);
+		}
+	}
+
+	merge.a_bounds[nchunks] = na;
+	merge.b_bounds[nchunks] = nb;
+
+	run_tasks(merge_chunk_task, &merge, nchunks, nthreads);
+
+	/* move the merged chunks together (the chunks only move to the left) */
+	for (i = 0; i < nchunks; i++)
+	{
+		char   *chunk = out +
+			(Size) (merge.a_bounds[i] + merge.b_bounds[i]) * eset->itemlen;
+		Size	len = (Size) merge.nmerged[i] * eset->itemlen;
+
+		if (ptr != chunk)
+			memmove(ptr, chunk, len);
+
+		ptr += len;
+	}
+
+	return ptr;
+}
+
+/*
+ * copy the (compacted) items into the output buffer, and for varlena types
+ * also the values referenced by them (into values, with the alignment
+ * padding zeroed so that equal sets are identical), with the offsets of the
+ * copied items updated - returns the number of bytes of values written
+ */
+static inline Size
+pack_items(element_set_t *eset, char *items, char *values)
+{
+	uint32	i;
+	Size	offset = 0;
+
+	Assert(eset->nall == eset->nsorted);
+
+	if (eset->typlen != -1)
+	{
+		memcpy(items, eset->data, (Size) eset->nall * eset->itemlen);
+		return 0;
+	}
+
+	/* copy the values in item order, and update the offsets */
+	for (i = 0; i < eset->nall; i++)
+	{
+		varlena_item_t	item;
+
+		memcpy(&item, eset->data + (Size) i * eset->itemlen, sizeof(varlena_item_t));
+
+		memset(values + offset, 0,
+			   att_align_nominal(offset, eset->typalign) - offset);
+		offset = att_align_nominal(offset, eset->typalign);
+
+		memcpy(values + offset, eset->arena + item.offset,
+			   VARHDRSZ + item.length);
+
+		item.offset = offset;
+		offset += VARHDRSZ + item.length;
+
+		/* copy the whole item (including the count), then fix offset */
+		memcpy(items, eset->data + (Size) i * eset->itemlen, eset->itemlen);
+		memcpy(items, &item, sizeof(varlena_item_t));
+		items += eset->itemlen;
+	}
+
+	return offset;
+}
+
+#endif							/* ELEMENT_SET_H */
@@ -0,0 +1,335 @@
+/* count_distinct for int and bigint */
+
+CREATE OR REPLACE FUNCTION count_distinct_append(internal, anyelement)
+    RETURNS internal
+    AS 'count_distinct', 'count_distinct_append'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION count_distinct_elements_append(internal, anyarray)
+    RETURNS internal
+    AS 'count_distinct', 'count_distinct_elements_append'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION count_distinct(internal)
+    RETURNS bigint
+    AS 'count_distinct', 'count_distinct'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION array_agg_distinct(internal, anynonarray)
+    RETURNS anyarray
+    AS 'count_distinct', 'array_agg_distinct_type_by_element'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION array_agg_distinct(internal, anyarray)
+    RETURNS anyarray
+    AS 'count_distinct', 'array_agg_distinct_type_by_array'
+    LANGUAGE C IMMUTABLE;
+
+/* Server supports parallel aggregation (9.6+) */
+
+/* serialize data */
+CREATE OR REPLACE FUNCTION count_distinct_serial(p_pointer internal)
+    RETURNS bytea
+    AS 'count_distinct', 'count_distinct_serial'
+    LANGUAGE C IMMUTABLE STRICT;
+
+/* deserialize data */
+CREATE OR REPLACE FUNCTION count_distinct_deserial(p_value bytea, p_dummy internal)
+    RETURNS internal
+    AS 'count_distinct', 'count_distinct_deserial'
+    LANGUAGE C IMMUTABLE STRICT;
+
+/* combine data */
+CREATE OR REPLACE FUNCTION count_distinct_combine(p_state_1 internal, p_state_2 internal)
+    RETURNS internal
+    AS 'count_distinct', 'count_distinct_combine'
+    LANGUAGE C IMMUTABLE;
+
+/*
+ * Create the aggregate functions
+ *
+ * The size of the state depends on the number of distinct values in the
+ * group, which the planner can't estimate, so SSPACE is just a rough guess
+ * (a state with about a thousand distinct 8-byte values, including the free
+ * space). It's a bit more conservative than the default for internal states
+ * (ALLOCSET_DEFAULT_INITSIZE), so with many groups the planner is a bit less
+ * likely to pick HashAggregate.
+ *
+ * The final functions only compact the state (without changing the set of
+ * values), so they're READ_ONLY and the state may be shared by multiple
+ * aggregates with the same input (e.g. count_distinct and array_agg_distinct
+ * on the same column). That's the default since PostgreSQL 11 (older
+ * releases share the state anyway, and ignore the option with a warning).
+ */
+CREATE AGGREGATE count_distinct(anyelement) (
+       SFUNC = count_distinct_append,
+       STYPE = internal,
+       SSPACE = 10240,
+       FINALFUNC = count_distinct,
+       COMBINEFUNC = count_distinct_combine,
+       SERIALFUNC = count_distinct_serial,
+       DESERIALFUNC = count_distinct_deserial,
+       FINALFUNC_MODIFY = READ_ONLY,
+       PARALLEL = SAFE
+);
+
+CREATE AGGREGATE array_agg_distinct(anynonarray) (
+       SFUNC = count_distinct_append,
+       STYPE = internal,
+       SSPACE = 10240,
+       FINALFUNC = array_agg_distinct,
+       FINALFUNC_EXTRA,
+       COMBINEFUNC = count_distinct_combine,
+       SERIALFUNC = count_distinct_serial,
+       DESERIALFUNC = count_distinct_deserial,
+       FINALFUNC_MODIFY = READ_ONLY,
+       PARALLEL = SAFE
+);
+
+CREATE AGGREGATE count_distinct_elements(anyarray) (
+       SFUNC = count_distinct_elements_append,
+       STYPE = internal,
+       SSPACE = 10240,
+       FINALFUNC = count_distinct,
+       COMBINEFUNC = count_distinct_combine,
+       SERIALFUNC = count_distinct_serial,
+       DESERIALFUNC = count_distinct_deserial,
+       FINALFUNC_MODIFY = READ_ONLY,
+       PARALLEL = SAFE
+);
+
+CREATE AGGREGATE array_agg_distinct_elements(anyarray) (
+       SFUNC = count_distinct_elements_append,
+       STYPE = internal,
+       SSPACE = 10240,
+       FINALFUNC = array_agg_distinct,
+       FINALFUNC_EXTRA,
+       COMBINEFUNC = count_distinct_combine,
+       SERIALFUNC = count_distinct_serial,
+       DESERIALFUNC = count_distinct_deserial,
+       FINALFUNC_MODIFY = READ_ONLY,
+       PARALLEL = SAFE
+);
+
+/*
+ * distinct_set - a persistent set of distinct values
+ *
+ * Uses the same format as the serialized aggregate state, so the sets can be
+ * stored (e.g. daily sets) and merged later, using the same code as parallel
+ * aggregation. The external format (text and binary) is portable between
+ * platforms for types passed by value, values of other types can only be
+ * read on a platform with the same byte order.
+ */
+CREATE TYPE distinct_set;
+
+CREATE OR REPLACE FUNCTION distinct_set_in(cstring)
+    RETURNS distinct_set
+    AS 'count_distinct', 'distinct_set_in'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION distinct_set_out(distinct_set)
+    RETURNS cstring
+    AS 'count_distinct', 'distinct_set_out'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION distinct_set_recv(internal)
+    RETURNS distinct_set
+    AS 'count_distinct', 'distinct_set_recv'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION distinct_set_send(distinct_set)
+    RETURNS bytea
+    AS 'count_distinct', 'distinct_set_send'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE distinct_set (
+       INPUT = distinct_set_in,
+       OUTPUT = distinct_set_out,
+       RECEIVE = distinct_set_recv,
+       SEND = distinct_set_send,
+       INTERNALLENGTH = VARIABLE,
+       ALIGNMENT = int4,
+       STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION cardinality(distinct_set)
+    RETURNS bigint
+    AS 'count_distinct', 'distinct_set_cardinality'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION distinct_set_final(internal)
+    RETURNS distinct_set
+    AS 'count_distinct', 'distinct_set_final'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION distinct_set_union_append(internal, distinct_set)
+    RETURNS internal
+    AS 'count_distinct', 'distinct_set_union_append'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE distinct_set_agg(anyelement) (
+       SFUNC = count_distinct_append,
+       STYPE = internal,
+       SSPACE = 10240,
+       FINALFUNC = distinct_set_final,
+       COMBINEFUNC = count_distinct_combine,
+       SERIALFUNC = count_distinct_serial,
+       DESERIALFUNC = count_distinct_deserial,
+       FINALFUNC_MODIFY = READ_ONLY,
+       PARALLEL = SAFE
+);
+
+CREATE AGGREGATE distinct_set_union(distinct_set) (
+       SFUNC = distinct_set_union_append,
+       STYPE = internal,
+       SSPACE = 10240,
+       FINALFUNC = distinct_set_final,
+       COMBINEFUNC = count_distinct_combine,
+       SERIALFUNC = count_distinct_serial,
+       DESERIALFUNC = count_distinct_deserial,
+       FINALFUNC_MODIFY = READ_ONLY,
+       PARALLEL = SAFE
+);
+
+/* intersection and Jaccard similarity of sets (or arrays of distinct values) */
+CREATE OR REPLACE FUNCTION count_distinct_intersect(distinct_set, distinct_set)
+    RETURNS bigint
+    AS 'count_distinct', 'distinct_set_intersect'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION count_distinct_intersect(anyarray, anyarray)
+    RETURNS bigint
+    AS 'count_distinct', 'array_intersect_distinct'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION jaccard(distinct_set, distinct_set)
+    RETURNS double precision
+    AS 'count_distinct', 'distinct_set_jaccard'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION jaccard(anyarray, anyarray)
+    RETURNS double precision
+    AS 'count_distinct', 'array_jaccard_distinct'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+/*
+ * counted sets (multisets), tracking the number of occurrences of values
+ *
+ * The second argument of the aggregates is stored in the state, so it has
+ * to be the same for all rows in a group.
+ */
+CREATE OR REPLACE FUNCTION count_distinct_counted_append(internal, anyelement, int)
+    RETURNS internal
+    AS 'count_distinct', 'count_distinct_counted_append'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION count_distinct_min_occurrences(internal)
+    RETURNS bigint
+    AS 'count_distinct', 'count_distinct_min_occurrences'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION top_values(internal, anynonarray, int)
+    RETURNS anyarray
+    AS 'count_distinct', 'top_values'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE count_distinct_min_occurrences(anyelement, int) (
+       SFUNC = count_distinct_counted_append,
+       STYPE = internal,
+       SSPACE = 10240,
+       FINALFUNC = count_distinct_min_occurrences,
+       COMBINEFUNC = count_distinct_combine,
+       SERIALFUNC = count_distinct_serial,
+       DESERIALFUNC = count_distinct_deserial,
+       FINALFUNC_MODIFY = READ_ONLY,
+       PARALLEL = SAFE
+);
+
+CREATE AGGREGATE top_values(anynonarray, int) (
+       SFUNC = count_distinct_counted_append,
+       STYPE = internal,
+       SSPACE = 10240,
+       FINALFUNC = top_values,
+       FINALFUNC_EXTRA,
+       COMBINEFUNC = count_distinct_combine,
+       SERIALFUNC = count_distinct_serial,
+       DESERIALFUNC = count_distinct_deserial,
+       FINALFUNC_MODIFY = READ_ONLY,
+       PARALLEL = SAFE
+);
+
+/*
+ * count_distinct on multiple columns (of fixed-length types), packed into
+ * a single composite key
+ */
+CREATE OR REPLACE FUNCTION count_distinct_multi_append(internal, "any", "any")
+    RETURNS internal
+    AS 'count_distinct', 'count_distinct_multi_append'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION count_distinct_multi_append(internal, "any", "any", "any")
+    RETURNS internal
+    AS 'count_distinct', 'count_distinct_multi_append'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE count_distinct("any", "any") (
+       SFUNC = count_distinct_multi_append,
+       STYPE = internal,
+       SSPACE = 10240,
+       FINALFUNC = count_distinct,
+       COMBINEFUNC = count_distinct_combine,
+       SERIALFUNC = count_distinct_serial,
+       DESERIALFUNC = count_distinct_deserial,
+       FINALFUNC_MODIFY = READ_ONLY,
+       PARALLEL = SAFE
+);
+
+CREATE AGGREGATE count_distinct("any", "any", "any") (
+       SFUNC = count_distinct_multi_append,
+       STYPE = internal,
+       SSPACE = 10240,
+       FINALFUNC = count_distinct,
+       COMBINEFUNC = count_distinct_combine,
+       SERIALFUNC = count_distinct_serial,
+       DESERIALFUNC = count_distinct_deserial,
+       FINALFUNC_MODIFY = READ_ONLY,
+       PARALLEL = SAFE
+);
+
+/*
+ * description of the final state (as jsonb), for capacity planning - the
+ * state is not compatible with count_distinct, so there is no combine
+ */
+CREATE OR REPLACE FUNCTION count_distinct_state_info_append(internal, anyelement)
+    RETURNS internal
+    AS 'count_distinct', 'count_distinct_state_info_append'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION count_distinct_state_info(internal)
+    RETURNS jsonb
+    AS 'count_distinct', 'count_distinct_state_info'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE count_distinct_state_info(anyelement) (
+       SFUNC = count_distinct_state_info_append,
+       STYPE = internal,
+       SSPACE = 10240,
+       FINALFUNC = count_distinct_state_info,
+       FINALFUNC_MODIFY = READ_ONLY,
+       PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION count_distinct_stats(OUT compactions bigint, OUT merges bigint,
+                                                OUT sort_time double precision, OUT bytes_copied bigint,
+                                                OUT reallocations bigint, OUT peak_state_size bigint,
+                                                OUT combine_calls bigint, OUT combine_bytes bigint,
+                                                OUT serial_calls bigint, OUT serial_bytes bigint,
+                                                OUT deserial_calls bigint, OUT deserial_bytes bigint)
+    RETURNS record
+    AS 'count_distinct', 'count_distinct_stats'
+    LANGUAGE C VOLATILE STRICT;
+
+CREATE OR REPLACE FUNCTION count_distinct_stats_reset()
+    RETURNS void
+    AS 'count_distinct', 'count_distinct_stats_reset'
+    LANGUAGE C VOLATILE STRICT;
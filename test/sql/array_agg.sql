@@ -28,4 +28,40 @@ SELECT array_agg_distinct_elements(array[null::int2]) a FROM generate_series(1,
 -- array_agg_elements: nulls and non-nulls
 SELECT array_agg(a order by a) FROM (SELECT unnest(array_agg_distinct_elements(array[x::int2, null, -x::int2])) a FROM test_data_0_50)_;
 
+-- uuid
+SELECT unnest(array_agg(a order by a)) FROM (SELECT unnest(array_agg_distinct(md5(mod(x,3)::text)::uuid)) a FROM test_data_1_50)_;
+
+-- interval
+SELECT unnest(array_agg(a order by a)) FROM (SELECT unnest(array_agg_distinct(mod(x,3) * interval '1 day')) a FROM test_data_1_50)_;
+
+-- array_agg_elements: uuid
+SELECT unnest(array_agg(a order by a)) FROM (SELECT unnest(array_agg_distinct_elements(array[md5(mod(x,2)::text)::uuid, null, md5('2')::uuid])) a FROM test_data_0_50)_;
+
+-- text
+SELECT array_agg(a order by a) FROM (SELECT unnest(array_agg_distinct(mod(x,10)::text)) a FROM test_data_1_50)_;
+
+-- array_agg_elements: text
+SELECT array_agg(a order by a) FROM (SELECT unnest(array_agg_distinct_elements(array[mod(x,5)::text, null, (mod(x,5) + 5)::text])) a FROM test_data_0_50)_;
+
+-- sorted output: int
+SELECT array_agg_distinct(x - 25) FROM test_data_1_50;
+
+-- sorted output: bigint
+SELECT array_agg_distinct((x - 5) * 1000000000000) FROM test_data_1_20;
+
+-- sorted output: float8 (negative zero and NaN)
+SELECT array_agg_distinct(v) FROM (VALUES (1.5::float8), (-2.5), ('-0'), (0), ('NaN'), ('-Infinity'), ('Infinity'), (-2.5)) t(v);
+
+-- sorted output: text
+SELECT array_agg_distinct(v) FROM (VALUES ('b'), ('a'), ('c'), ('a')) t(v);
+
+-- sorted output: interval
+SELECT array_agg_distinct(v) FROM (VALUES (interval '2 days'), ('1 day'), ('3 hours'), ('1 day')) t(v);
+
+-- sorted output: array elements
+SELECT array_agg_distinct_elements(array[x::int2, null, -x::int2]) FROM test_data_0_50 WHERE x <= 3;
+
+-- shared state: count_distinct and array_agg_distinct on the same input
+SELECT mod(x,3) AS g, count_distinct(mod(x,5)) AS c, array_agg_distinct(mod(x,5)) AS a FROM test_data_1_50 WHERE x <= 10 GROUP BY 1 ORDER BY 1;
+
 ROLLBACK;
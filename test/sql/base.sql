@@ -80,4 +80,70 @@ SELECT sum(cnt) FROM (
        GROUP BY x
 ) _;
 
+-- uuid
+SELECT count_distinct(md5(x::text)::uuid) FROM test_data_1_1000;
+SELECT count_distinct(md5(mod(x,10)::text)::uuid) FROM test_data_1_1000;
+
+-- interval
+SELECT count_distinct(mod(x,10) * interval '1 day') FROM test_data_1_1000;
+
+-- name
+SELECT count_distinct(('n' || mod(x,10))::name) FROM test_data_1_1000;
+
+-- array of uuid
+SELECT count_distinct_elements(z) FROM (
+    SELECT ARRAY[md5(x::text)::uuid, md5((x+1)::text)::uuid] AS z FROM generate_series(1,1000) s(x)
+) foo;
+
+-- text
+SELECT count_distinct(x::text) FROM test_data_1_1000;
+SELECT count_distinct(mod(x,10)::text) FROM test_data_1_1000;
+
+-- text (long compressed values)
+SELECT count_distinct(repeat(mod(x,3)::text, 5000)) FROM test_data_1_1000;
+
+-- numeric
+SELECT count_distinct(mod(x,10) * 1.5) FROM test_data_1_1000;
+
+-- bytea
+SELECT count_distinct(decode(md5(mod(x,10)::text), 'hex')) FROM test_data_1_1000;
+
+-- jsonb
+SELECT count_distinct(jsonb_build_object('a', mod(x,10))) FROM test_data_1_1000;
+
+-- array of text
+SELECT count_distinct_elements(z) FROM (
+    SELECT ARRAY[x::text, NULL, (x+1)::text] AS z FROM generate_series(1,1000) s(x)
+) foo;
+
+-- float8 (negative zero is equal to zero)
+SELECT count_distinct(v) FROM (VALUES (0::float8), ('-0'), ('NaN'), (-'NaN'::float8)) t(v);
+
+-- large arrays with NULLs
+SELECT count_distinct_elements(z) FROM (
+    SELECT array_agg(CASE WHEN mod(x,7) = 0 THEN NULL ELSE x END) AS z
+    FROM generate_series(1,10000) s(x) GROUP BY mod(x,10)
+) foo;
+
+SELECT count_distinct_elements(z) FROM (
+    SELECT array_agg(CASE WHEN mod(x,7) = 0 THEN NULL ELSE mod(x,100)::text END) AS z
+    FROM generate_series(1,10000) s(x) GROUP BY mod(x,10)
+) foo;
+
+-- multi-dimensional arrays
+SELECT count_distinct_elements(ARRAY[[x, x+1], [x+2, NULL]]) FROM generate_series(1,1000) s(x);
+
+-- state size estimate and final function behavior
+SELECT aggfnoid::regprocedure::text COLLATE "C" AS aggregate, aggtransspace, aggfinalmodify
+  FROM pg_aggregate JOIN pg_proc p ON (p.oid = aggfnoid)
+ WHERE p.pronamespace = 'public'::regnamespace ORDER BY 1;
+
+-- multiple columns (packed into a single key)
+SELECT count_distinct(x, mod(x,10)) FROM test_data_1_1000;
+SELECT count_distinct(mod(x,10), mod(x,4)) FROM test_data_1_1000;
+SELECT count_distinct(mod(x,10)::bigint, mod(x,4)::int2) FROM test_data_1_1000;
+SELECT count_distinct(mod(x,2), mod(x,3), mod(x,5)) FROM test_data_1_1000;
+SELECT count_distinct(md5(mod(x,7)::text)::uuid, mod(x,3)) FROM test_data_1_1000;
+SELECT count_distinct(x, NULLIF(mod(x,10), 0)) FROM test_data_1_1000;
+
 ROLLBACK;
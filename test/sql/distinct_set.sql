@@ -0,0 +1,49 @@
+\set ECHO none
+\i test/sql/setup/setup.sql
+
+-- build the sets
+SELECT cardinality(distinct_set_agg(x)) FROM test_data_1_1000;
+SELECT cardinality(distinct_set_agg(mod(x,10))) FROM test_data_1_1000;
+SELECT cardinality(distinct_set_agg(md5(mod(x,300)::text))) FROM test_data_1_1000;
+
+-- empty input
+SELECT distinct_set_agg(x) IS NULL FROM test_data_1_1000 WHERE x > 1000;
+
+-- text format
+SELECT distinct_set_agg(x) FROM (VALUES (3), (1), (2), (-1), (2)) v(x);
+SELECT cardinality('\x016e73690004000000047fffffff800000018000000280000003'::distinct_set);
+
+-- merge stored sets
+CREATE TABLE test_sets AS
+    SELECT mod(x,10) AS g, distinct_set_agg(mod(x,100)) AS s FROM test_data_1_1000 GROUP BY 1;
+CREATE TABLE test_text_sets AS
+    SELECT mod(x,4) AS g, distinct_set_agg(mod(x,50)::text) AS s FROM test_data_1_1000 GROUP BY 1;
+ANALYZE test_sets;
+ANALYZE test_text_sets;
+
+SELECT g, cardinality(s) FROM test_sets ORDER BY g;
+SELECT cardinality(distinct_set_union(s)) FROM test_sets;
+SELECT mod(g,2), cardinality(distinct_set_union(s)) FROM test_sets GROUP BY 1 ORDER BY 1;
+SELECT cardinality(distinct_set_union(s)) FROM test_text_sets;
+SELECT count(*) FROM test_text_sets WHERE s::text::distinct_set::text = s::text;
+
+-- intersection and similarity
+SELECT count_distinct_intersect(distinct_set_agg(x) FILTER (WHERE x <= 600), distinct_set_agg(x) FILTER (WHERE x > 400)) FROM test_data_1_1000;
+SELECT jaccard(distinct_set_agg(x) FILTER (WHERE x <= 600), distinct_set_agg(x) FILTER (WHERE x > 400)) FROM test_data_1_1000;
+SELECT count_distinct_intersect(distinct_set_agg(x) FILTER (WHERE x <= 10), distinct_set_agg(x)) FROM test_data_1_1000;
+SELECT count_distinct_intersect(distinct_set_agg(md5(x::text)) FILTER (WHERE x <= 600), distinct_set_agg(md5(x::text)) FILTER (WHERE x > 400)) FROM test_data_1_1000;
+SELECT count_distinct_intersect(a.s, b.s) FROM test_sets a, test_sets b WHERE a.g = 0 AND b.g = 5;
+SELECT count_distinct_intersect(ARRAY[1,2,2,3,4], ARRAY[4,3,3,5]);
+SELECT jaccard(ARRAY[1,2,2,3,4], ARRAY[4,3,3,5]);
+SELECT jaccard('{}'::int[], '{}'::int[]) IS NULL;
+SELECT jaccard('{NULL}'::int[], '{NULL,NULL}'::int[]) IS NULL;
+SELECT jaccard('{}'::int[], ARRAY[1,2]), count_distinct_intersect('{}'::int[], ARRAY[1,2]);
+SELECT count_distinct_intersect('{NULL}'::text[], '{}'::text[]);
+
+-- sets of different types can't be merged (the last statement, as it aborts the transaction)
+\set VERBOSITY terse
+SELECT distinct_set_union(s) FROM (
+    SELECT distinct_set_agg(1::int) AS s UNION ALL SELECT distinct_set_agg(1::bigint)
+) foo;
+
+ROLLBACK;
@@ -0,0 +1,21 @@
+\set ECHO none
+\i test/sql/setup/setup.sql
+
+-- ratio of duplicates removed by the compactions
+SELECT (info->>'dedup_ratio')::float8 = 0 AS distinct_values
+  FROM (SELECT count_distinct_state_info(x) AS info FROM test_data_1_1000) foo;
+
+SELECT (info->>'dedup_ratio')::float8 > 0 AS duplicate_values
+  FROM (SELECT count_distinct_state_info(mod(x,200)) AS info FROM test_data_1_1000) foo;
+
+-- the growth policy does not change the results
+SET count_distinct.free_space = 0.01;
+SET count_distinct.fast_growth_ratio = 0;
+SET count_distinct.slow_growth_ratio = 0;
+SELECT count_distinct(mod(x,300)), count_distinct(x) FROM generate_series(1,100000) s(x);
+
+SET count_distinct.free_space = 0.9;
+SET count_distinct.fast_growth_ratio = 1;
+SELECT count_distinct(mod(x,300)), count_distinct(x) FROM generate_series(1,100000) s(x);
+
+ROLLBACK;
@@ -0,0 +1,12 @@
+\set ECHO none
+\i test/sql/setup/setup.sql
+
+-- small sets fit into the limit
+SET count_distinct.max_memory = '1MB';
+SELECT count_distinct(x) FROM test_data_1_1000;
+
+-- large sets exceed it (the last statement, as it aborts the transaction)
+\set VERBOSITY terse
+SELECT count_distinct(x) FROM generate_series(1,1000000) s(x);
+
+ROLLBACK;
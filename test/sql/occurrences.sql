@@ -0,0 +1,28 @@
+\set ECHO none
+\i test/sql/setup/setup.sql
+
+-- value v occurs v times
+CREATE TABLE test_freq AS SELECT v FROM generate_series(1,10) v, generate_series(1,v) r;
+ANALYZE test_freq;
+
+-- values with at least k occurrences
+SELECT count_distinct_min_occurrences(v, 5) FROM test_freq;
+SELECT count_distinct_min_occurrences(v, 1) FROM test_freq;
+SELECT count_distinct_min_occurrences(v, 11) FROM test_freq;
+SELECT count_distinct_min_occurrences(md5(v::text), 8) FROM test_freq;
+SELECT count_distinct_min_occurrences(mod(x,100), 10) FROM test_data_1_1000;
+
+-- most frequent values
+SELECT top_values(v, 3) FROM test_freq;
+SELECT top_values(v::text, 3) FROM test_freq;
+SELECT top_values(v, 0) FROM test_freq;
+SELECT mod(v,2) AS g, top_values(v::bigint, 2) FROM test_freq GROUP BY 1 ORDER BY 1;
+
+-- values with the same frequency are in the order of values
+SELECT top_values(mod(x,7), 2) FROM test_data_1_1000;
+
+-- the argument has to be the same for all rows (the last statement, as it aborts the transaction)
+\set VERBOSITY terse
+SELECT top_values(v, v) FROM test_freq;
+
+ROLLBACK;
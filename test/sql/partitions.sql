@@ -0,0 +1,13 @@
+\set ECHO none
+\i test/sql/setup/setup.sql
+
+-- large batches of new items are partitioned before sorting, with the same results
+SET count_distinct.partition_bits = 4;
+SELECT count_distinct(x::bigint % 700000) FROM generate_series(1,1000000) s(x);
+SELECT count_distinct(md5((x % 100000)::text)) FROM generate_series(1,400000) s(x);
+
+-- the keys remain sorted (including negative values)
+WITH d AS (SELECT (x::bigint * 7919 % 400000)::int - 200000 AS v FROM generate_series(1,1000000) s(x))
+SELECT array_agg_distinct(v) = (SELECT array_agg(DISTINCT v) FROM d) AS matches FROM d;
+
+ROLLBACK;
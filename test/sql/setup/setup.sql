@@ -3,7 +3,7 @@
 BEGIN;
 
 -- install the module
-\i sql/count_distinct--3.0.2.sql
+\i sql/count_distinct--3.1.0.sql
 
 -- create and analyze tables (parallel plans work only on real tables, not on SRFs)
 create table test_data_1_20 as select generate_series(1,20) x;
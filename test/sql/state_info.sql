@@ -0,0 +1,30 @@
+\set ECHO none
+\i test/sql/setup/setup.sql
+
+-- small set (kept in the initial array, never sorted)
+SELECT info->'distinct' AS ndistinct, info->'values' AS nvalues, info->'compactions' AS compactions,
+       info->>'representation' AS representation, info->>'key' AS key,
+       info->'item_size' AS item_size, info->'serialized' AS serialized
+  FROM (SELECT count_distinct_state_info(mod(x,10)) AS info FROM test_data_1_1000) foo;
+
+-- larger sets (grown and compacted)
+SELECT info->'distinct' AS ndistinct, info->'values' AS nvalues, (info->>'compactions')::int > 0 AS compactions,
+       info->>'representation' AS representation, info->>'key' AS key,
+       info->'item_size' AS item_size, info->'serialized' AS serialized,
+       (info->>'allocated')::bigint >= (info->>'used')::bigint AS allocated
+  FROM (SELECT count_distinct_state_info(x) AS info FROM test_data_1_1000) foo;
+
+SELECT info->'distinct' AS ndistinct, info->'values' AS nvalues, (info->>'compactions')::int > 0 AS compactions,
+       info->>'representation' AS representation, info->>'key' AS key,
+       info->'item_size' AS item_size, info->'serialized' AS serialized,
+       (info->>'allocated')::bigint >= (info->>'used')::bigint AS allocated
+  FROM (SELECT count_distinct_state_info(mod(x,10)::text) AS info FROM test_data_1_1000) foo;
+
+-- per group, NULL values are not counted
+SELECT g, info->'distinct' AS ndistinct, info->'values' AS nvalues
+  FROM (SELECT mod(x,3) AS g, count_distinct_state_info(NULLIF(mod(x,7), 0)) AS info
+          FROM test_data_1_1000 GROUP BY 1) foo ORDER BY 1;
+
+SELECT count_distinct_state_info(NULL::int) FROM test_data_1_20;
+
+ROLLBACK;
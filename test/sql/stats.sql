@@ -0,0 +1,21 @@
+\set ECHO none
+\i test/sql/setup/setup.sql
+
+-- statistics are collected only when enabled
+SET max_parallel_workers_per_gather = 0;
+SELECT count_distinct_stats_reset();
+SELECT count_distinct(x) FROM test_data_1_1000;
+SELECT compactions, merges, bytes_copied, reallocations, peak_state_size FROM count_distinct_stats();
+
+SET count_distinct.track_stats = on;
+SELECT count_distinct(x) FROM test_data_1_1000;
+SELECT compactions > 0 AS compactions, merges > 0 AS merges, bytes_copied > 0 AS bytes_copied,
+       reallocations > 0 AS reallocations, peak_state_size >= 4000 AS peak_state_size,
+       combine_calls, serial_calls, deserial_calls
+  FROM count_distinct_stats();
+
+-- reset discards the statistics
+SELECT count_distinct_stats_reset();
+SELECT compactions, merges, sort_time, bytes_copied, peak_state_size FROM count_distinct_stats();
+
+ROLLBACK;
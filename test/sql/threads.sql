@@ -0,0 +1,16 @@
+\set ECHO none
+\i test/sql/setup/setup.sql
+
+-- large batches sorted and merged by multiple threads, with the same results
+SET count_distinct.max_threads = 4;
+SELECT count_distinct(x::bigint % 700000) FROM generate_series(1,1000000) s(x);
+SELECT count_distinct(md5((x % 100000)::text)) FROM generate_series(1,400000) s(x);
+
+-- the keys remain sorted (including negative values)
+WITH d AS (SELECT (x::bigint * 7919 % 400000)::int - 200000 AS v FROM generate_series(1,1000000) s(x))
+SELECT array_agg_distinct(v) = (SELECT array_agg(DISTINCT v) FROM d) AS matches FROM d;
+
+-- counted sets (values with at least 4 occurrences)
+SELECT count_distinct_min_occurrences(x % 300000, 4) FROM generate_series(1,1000000) s(x);
+
+ROLLBACK;